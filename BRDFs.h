@@ -1,6 +1,7 @@
 #pragma once
 #include <cassert>
 #include "Math.h"
+#include "Float8.h"
 
 namespace dae
 {
@@ -59,48 +60,93 @@ namespace dae
 			return f0 + (ColorRGB{ 1.0f,1.0f,1.0f } - f0) * powf(1.0f - Vector3::Dot(h, v), 5);
 		}
 
+		//Squared GGX alpha (UE4 - squared(roughness)), constant per material
+		static float GGX_AlphaSquared(float roughness)
+		{
+			return Square(Square(roughness));
+		}
+
 		/**
-		 * \brief BRDF NormalDistribution >> Trowbridge-Reitz GGX (UE4 implemetation - squared(roughness))
+		 * \brief BRDF NormalDistribution >> Trowbridge-Reitz GGX, with the squared alpha precomputed
 		 * \param n Surface normal
 		 * \param h Normalized half vector
-		 * \param roughness Roughness of the material
+		 * \param alphaSquared GGX_AlphaSquared(roughness)
 		 * \return BRDF Normal Distribution Term using Trowbridge-Reitz GGX
 		 */
-		static float NormalDistribution_GGX(const Vector3& n, const Vector3& h, float roughness)
+		static float NormalDistribution_GGX_AlphaSquared(const Vector3& n, const Vector3& h, float alphaSquared)
 		{
-			const float dividend = Square(roughness);
-
 			const float dotNHSquared = Square(Vector3::Dot(n, h));
 
-			const float b = Square(dividend) - 1;
+			const float b = alphaSquared - 1;
 
 			const float c = (dotNHSquared * b) + 1;
 
 			const float divisor = static_cast<float>(M_PI) * Square(c);
 
-			const float N = Square(dividend) / divisor;
+			const float N = alphaSquared / divisor;
 
 			return N;
 		}
 
+		/**
+		 * \brief BRDF NormalDistribution >> Trowbridge-Reitz GGX (UE4 implemetation - squared(roughness))
+		 * \param n Surface normal
+		 * \param h Normalized half vector
+		 * \param roughness Roughness of the material
+		 * \return BRDF Normal Distribution Term using Trowbridge-Reitz GGX
+		 */
+		static float NormalDistribution_GGX(const Vector3& n, const Vector3& h, float roughness)
+		{
+			return NormalDistribution_GGX_AlphaSquared(n, h, GGX_AlphaSquared(roughness));
+		}
+
+		//K of the Schlick GGX geometry term for direct lighting (UE4 - squared(roughness)), constant per material
+		static float SchlickGGX_DirectK(float roughness)
+		{
+			return Square(Square(roughness) + 1) / 8;
+		}
 
 		/**
-		 * \brief BRDF Geometry Function >> Schlick GGX (Direct Lighting + UE4 implementation - squared(roughness))
+		 * \brief BRDF Geometry Function >> Schlick GGX, with K precomputed
 		 * \param n Normal of the surface
 		 * \param v Normalized view direction
-		 * \param roughness Roughness of the material
+		 * \param k SchlickGGX_DirectK(roughness)
 		 * \return BRDF Geometry Term using SchlickGGX
 		 */
-		static float GeometryFunction_SchlickGGX(const Vector3& n, const Vector3& v, float roughness)
+		static float GeometryFunction_SchlickGGX_K(const Vector3& n, const Vector3& v, float k)
 		{
-			const float Kdirect = Square(Square(roughness) + 1) / 8;
 			const float dotNV = std::max(Vector3::Dot(n,v),0.f);
 
-			const float G = dotNV / ((dotNV * (1 - Kdirect)) + Kdirect);
+			const float G = dotNV / ((dotNV * (1 - k)) + k);
 
 			return G;
 		}
-		 
+
+		/**
+		 * \brief BRDF Geometry Function >> Schlick GGX (Direct Lighting + UE4 implementation - squared(roughness))
+		 * \param n Normal of the surface
+		 * \param v Normalized view direction
+		 * \param roughness Roughness of the material
+		 * \return BRDF Geometry Term using SchlickGGX
+		 */
+		static float GeometryFunction_SchlickGGX(const Vector3& n, const Vector3& v, float roughness)
+		{
+			return GeometryFunction_SchlickGGX_K(n, v, SchlickGGX_DirectK(roughness));
+		}
+
+		/**
+		 * \brief BRDF Geometry Function >> Smith (Direct Lighting), with K precomputed
+		 * \param n Normal of the surface
+		 * \param v Normalized view direction
+		 * \param l Normalized light direction
+		 * \param k SchlickGGX_DirectK(roughness)
+		 * \return BRDF Geometry Term using Smith (> SchlickGGX(n,v) * SchlickGGX(n,l))
+		 */
+		static float GeometryFunction_Smith_K(const Vector3& n, const Vector3& v, const Vector3& l, float k)
+		{
+			return GeometryFunction_SchlickGGX_K(n, v, k) * GeometryFunction_SchlickGGX_K(n, l, k);
+		}
+
 		/**
 		 * \brief BRDF Geometry Function >> Smith (Direct Lighting)
 		 * \param n Normal of the surface
@@ -111,9 +157,64 @@ namespace dae
 		 */
 		static float GeometryFunction_Smith(const Vector3& n, const Vector3& v, const Vector3& l, float roughness)
 		{
-
-			return GeometryFunction_SchlickGGX(n, v, roughness) * GeometryFunction_SchlickGGX(n, l, roughness);
+			return GeometryFunction_Smith_K(n, v, l, SchlickGGX_DirectK(roughness));
 		}
 
+
+		/**
+		 * \brief Batched BRDFs: the functions above for 8 (pixel, light) pairs at once, on SoA lanes.
+		 * Same math, but powf with an integer exponent is multiplied out and the Phong powf is Float8::Pow,
+		 * so results can differ from the scalar ones in the last bits.
+		 */
+		namespace Batched
+		{
+			static ColorRGBx8 Lambert(const ColorRGBx8& kd, const ColorRGB& cd)
+			{
+				return (kd * ColorRGBx8::Set(cd.r, cd.g, cd.b)) / Float8::Set(float(M_PI));
+			}
+
+			//Phong of a white specular color, so one value for every channel
+			static Float8 Phong(float ks, float exp, const Vector3x8& l, const Vector3x8& v, const Vector3x8& n)
+			{
+				const Vector3x8 reflect = l - (Float8::Set(2.f) * Vector3x8::Dot(l, n)) * n;
+				const Float8 cosAlpha = Float8::Max(Vector3x8::Dot(reflect, v), Float8::Set(0.f));
+
+				return Float8::Set(ks) * Float8::Pow(cosAlpha, Float8::Set(exp));
+			}
+
+			static ColorRGBx8 FresnelFunction_Schlick(const Vector3x8& h, const Vector3x8& v, const ColorRGB& f0)
+			{
+				const Float8 x = Float8::Set(1.0f) - Vector3x8::Dot(h, v);
+				const Float8 xSquared = x * x;
+				const Float8 x5 = xSquared * xSquared * x;
+
+				return
+				{
+					Float8::Set(f0.r) + Float8::Set(1.0f - f0.r) * x5,
+					Float8::Set(f0.g) + Float8::Set(1.0f - f0.g) * x5,
+					Float8::Set(f0.b) + Float8::Set(1.0f - f0.b) * x5
+				};
+			}
+
+			static Float8 NormalDistribution_GGX_AlphaSquared(const Vector3x8& n, const Vector3x8& h, float alphaSquared)
+			{
+				const Float8 dotNH = Vector3x8::Dot(n, h);
+				const Float8 c = (dotNH * dotNH * Float8::Set(alphaSquared - 1)) + Float8::Set(1.f);
+
+				return Float8::Set(alphaSquared) / (Float8::Set(static_cast<float>(M_PI)) * c * c);
+			}
+
+			static Float8 GeometryFunction_SchlickGGX_K(const Vector3x8& n, const Vector3x8& v, float k)
+			{
+				const Float8 dotNV = Float8::Max(Vector3x8::Dot(n, v), Float8::Set(0.f));
+
+				return dotNV / ((dotNV * Float8::Set(1 - k)) + Float8::Set(k));
+			}
+
+			static Float8 GeometryFunction_Smith_K(const Vector3x8& n, const Vector3x8& v, const Vector3x8& l, float k)
+			{
+				return GeometryFunction_SchlickGGX_K(n, v, k) * GeometryFunction_SchlickGGX_K(n, l, k);
+			}
+		}
 	}
 }
\ No newline at end of file
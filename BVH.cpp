@@ -0,0 +1,590 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <execution>
+#include <future>
+#include <numeric>
+#include <thread>
+
+namespace dae
+{
+	struct BVH::BuildContext
+	{
+		const std::vector<AABB>& primBounds;
+		std::vector<Vector3> centroids;
+
+		std::atomic<uint32_t> nodesUsed;
+		std::atomic<int> freeTaskSlots; //Subtrees that may still be built as tasks next to the ones running
+	};
+
+	namespace
+	{
+		struct Bin
+		{
+			AABB bounds{};
+			uint32_t count = 0;
+		};
+
+		using BinSet = std::array<std::array<Bin, BVH::BinCount>, 3>;
+
+		AABB CalculateCentroidBounds(const uint32_t* pPrimIndices, uint32_t count, const std::vector<Vector3>& centroids)
+		{
+			AABB bounds{};
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				bounds.Grow(centroids[pPrimIndices[i]]);
+			}
+			return bounds;
+		}
+
+		void FillBins(BinSet& bins, const uint32_t* pPrimIndices, uint32_t count, const AABB& centroidBounds, const Vector3& binScale,
+			const std::vector<AABB>& primBounds, const std::vector<Vector3>& centroids)
+		{
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const uint32_t primIndex = pPrimIndices[i];
+				const Vector3& centroid = centroids[primIndex];
+
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					const int binIndex = std::min(BVH::BinCount - 1, static_cast<int>((centroid[axis] - centroidBounds.min[axis]) * binScale[axis]));
+
+					Bin& bin = bins[axis][binIndex];
+					bin.bounds.Grow(primBounds[primIndex]);
+					++bin.count;
+				}
+			}
+		}
+
+		//False when every slot is taken
+		bool TakeTaskSlot(std::atomic<int>& freeTaskSlots)
+		{
+			int freeSlots = freeTaskSlots.load();
+			while (freeSlots > 0)
+			{
+				if (freeTaskSlots.compare_exchange_weak(freeSlots, freeSlots - 1))
+					return true;
+			}
+			return false;
+		}
+
+		//Splits [0, count) in chunks, runs the work on every chunk in parallel and hands the per-chunk results back for merging
+		template<typename Result, typename ChunkFunction>
+		std::vector<Result> ForEachChunk(uint32_t count, ChunkFunction&& chunkFunction)
+		{
+			const uint32_t chunkCount = std::max(1u, std::thread::hardware_concurrency()) * 4;
+			const uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+			std::vector<Result> results(chunkCount);
+			std::vector<uint32_t> chunkIndices(chunkCount);
+			std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+
+			std::for_each(std::execution::par, chunkIndices.begin(), chunkIndices.end(), [&](uint32_t chunk)
+				{
+					const uint32_t begin = std::min(count, chunk * chunkSize);
+					const uint32_t end = std::min(count, begin + chunkSize);
+					chunkFunction(results[chunk], begin, end - begin);
+				});
+
+			return results;
+		}
+	}
+
+	void BVH::Build(const std::vector<AABB>& primBounds)
+	{
+		const uint32_t primCount = static_cast<uint32_t>(primBounds.size());
+
+		nodes.clear();
+		primIndices.resize(primCount);
+		std::iota(primIndices.begin(), primIndices.end(), 0);
+
+		if (primCount == 0)
+			return;
+
+		//One task per core at most, the binning and partitioning of large ranges run on the parallel algorithms next to them
+		const int coreCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+		BuildContext context{ primBounds, {}, 1, coreCount - 1 };
+		context.centroids.resize(primCount);
+		std::transform(std::execution::par_unseq, primBounds.begin(), primBounds.end(), context.centroids.begin(), [](const AABB& bounds)
+			{
+				return bounds.Center();
+			});
+
+		//A binary tree with N leaves never needs more than 2N - 1 nodes
+		nodes.resize(2 * static_cast<size_t>(primCount) - 1);
+
+		BVHNode& root = nodes[0];
+		root.leftFirst = 0;
+		root.primCount = primCount;
+		UpdateNodeBounds(0, primBounds);
+
+		Subdivide(0, context, 0);
+
+		nodes.resize(context.nodesUsed);
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primBounds)
+	{
+		assert(primBounds.size() == primIndices.size());
+
+		//Children are always allocated after their parent, so a reverse sweep visits them first
+		for (int nodeIndex = static_cast<int>(nodes.size()) - 1; nodeIndex >= 0; --nodeIndex)
+		{
+			BVHNode& node = nodes[nodeIndex];
+
+			if (node.IsLeaf())
+			{
+				UpdateNodeBounds(static_cast<uint32_t>(nodeIndex), primBounds);
+				continue;
+			}
+
+			const BVHNode& left = nodes[node.leftFirst];
+			const BVHNode& right = nodes[node.leftFirst + 1];
+
+			node.aabbMin = Vector3::Min(left.aabbMin, right.aabbMin);
+			node.aabbMax = Vector3::Max(left.aabbMax, right.aabbMax);
+		}
+	}
+
+	void BVH::UpdateNodeBounds(uint32_t nodeIndex, const std::vector<AABB>& primBounds)
+	{
+		BVHNode& node = nodes[nodeIndex];
+
+		AABB bounds{};
+		for (uint32_t i = 0; i < node.primCount; ++i)
+		{
+			bounds.Grow(primBounds[primIndices[node.leftFirst + i]]);
+		}
+
+		node.aabbMin = bounds.min;
+		node.aabbMax = bounds.max;
+	}
+
+	void BVH::Subdivide(uint32_t nodeIndex, BuildContext& context, int depth)
+	{
+		const uint32_t first = nodes[nodeIndex].leftFirst;
+		const uint32_t count = nodes[nodeIndex].primCount;
+
+		if (count <= 1)
+			return;
+
+		uint32_t* pRange = primIndices.data() + first;
+		const bool isParallelRange = count >= ParallelRangeThreshold;
+
+		AABB centroidBounds{};
+		if (isParallelRange)
+		{
+			for (const AABB& chunkBounds : ForEachChunk<AABB>(count, [&](AABB& result, uint32_t begin, uint32_t chunkCount)
+				{
+					result = CalculateCentroidBounds(pRange + begin, chunkCount, context.centroids);
+				}))
+			{
+				centroidBounds.Grow(chunkBounds);
+			}
+		}
+		else
+		{
+			centroidBounds = CalculateCentroidBounds(pRange, count, context.centroids);
+		}
+
+		const Vector3 extent = centroidBounds.max - centroidBounds.min;
+		Vector3 binScale{};
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			binScale[axis] = extent[axis] > 0.f ? BinCount / extent[axis] : 0.f;
+		}
+
+		//Deep enough that the SAH is not doing well: halve the range from here on, which bounds the depth of the tree
+		const bool isDepthCapped = depth >= MaxSAHDepth;
+
+		BinSet bins{};
+		if (isDepthCapped)
+		{
+			//Left empty, so no SAH split is found
+		}
+		else if (isParallelRange)
+		{
+			for (const BinSet& chunkBins : ForEachChunk<BinSet>(count, [&](BinSet& result, uint32_t begin, uint32_t chunkCount)
+				{
+					FillBins(result, pRange + begin, chunkCount, centroidBounds, binScale, context.primBounds, context.centroids);
+				}))
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					for (int i = 0; i < BinCount; ++i)
+					{
+						bins[axis][i].bounds.Grow(chunkBins[axis][i].bounds);
+						bins[axis][i].count += chunkBins[axis][i].count;
+					}
+				}
+			}
+		}
+		else
+		{
+			FillBins(bins, pRange, count, centroidBounds, binScale, context.primBounds, context.centroids);
+		}
+
+		//Sweep the bin boundaries of every axis
+		int bestAxis = -1;
+		int bestSplit = 0;
+		float bestCost = FLT_MAX;
+		AABB bestLeftBounds{};
+		AABB bestRightBounds{};
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (binScale[axis] == 0.f)
+				continue;
+
+			std::array<AABB, BinCount - 1> rightBounds{};
+			std::array<uint32_t, BinCount - 1> rightCounts{};
+
+			AABB bounds{};
+			uint32_t primsRight = 0;
+			for (int i = BinCount - 1; i > 0; --i)
+			{
+				bounds.Grow(bins[axis][i].bounds);
+				primsRight += bins[axis][i].count;
+				rightBounds[i - 1] = bounds;
+				rightCounts[i - 1] = primsRight;
+			}
+
+			AABB leftBounds{};
+			uint32_t primsLeft = 0;
+			for (int i = 0; i < BinCount - 1; ++i)
+			{
+				leftBounds.Grow(bins[axis][i].bounds);
+				primsLeft += bins[axis][i].count;
+
+				if (primsLeft == 0 || rightCounts[i] == 0)
+					continue;
+
+				const float cost = leftBounds.HalfArea() * primsLeft + rightBounds[i].HalfArea() * rightCounts[i];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+					bestLeftBounds = leftBounds;
+					bestRightBounds = rightBounds[i];
+				}
+			}
+		}
+
+		const BVHNode& node = nodes[nodeIndex];
+		const float parentArea = AABB{ node.aabbMin, node.aabbMax }.HalfArea();
+
+		if (count <= MaxLeafSize)
+		{
+			if (isDepthCapped)
+				return;
+
+			const float leafCost = IntersectionCost * count;
+			const float splitCost = (bestAxis != -1 && parentArea > 0.f) ? TraversalCost + IntersectionCost * bestCost / parentArea : FLT_MAX;
+
+			if (splitCost >= leafCost)
+				return;
+		}
+
+		uint32_t leftCount = count / 2;
+		if (bestAxis != -1)
+		{
+			const auto isLeft = [&](uint32_t primIndex)
+				{
+					const float offset = context.centroids[primIndex][bestAxis] - centroidBounds.min[bestAxis];
+					return std::min(BinCount - 1, static_cast<int>(offset * binScale[bestAxis])) <= bestSplit;
+				};
+
+			const uint32_t* pMiddle = isParallelRange ?
+				std::partition(std::execution::par, pRange, pRange + count, isLeft) :
+				std::partition(pRange, pRange + count, isLeft);
+
+			leftCount = static_cast<uint32_t>(pMiddle - pRange);
+		}
+		else if (isDepthCapped)
+		{
+			int longestAxis = 0;
+			for (int axis = 1; axis < 3; ++axis)
+			{
+				if (extent[axis] > extent[longestAxis])
+					longestAxis = axis;
+			}
+
+			std::nth_element(pRange, pRange + leftCount, pRange + count, [&](uint32_t a, uint32_t b)
+				{
+					return context.centroids[a][longestAxis] < context.centroids[b][longestAxis];
+				});
+		}
+
+		//All centroids coincide (or the depth is capped), but the leaf is too big: split the range in half
+		const bool isMedianSplit = bestAxis == -1;
+
+		const uint32_t leftIndex = context.nodesUsed.fetch_add(2);
+
+		BVHNode& left = nodes[leftIndex];
+		left.leftFirst = first;
+		left.primCount = leftCount;
+
+		BVHNode& right = nodes[leftIndex + 1];
+		right.leftFirst = first + leftCount;
+		right.primCount = count - leftCount;
+
+		nodes[nodeIndex].leftFirst = leftIndex;
+		nodes[nodeIndex].primCount = 0;
+
+		if (isMedianSplit)
+		{
+			UpdateNodeBounds(leftIndex, context.primBounds);
+			UpdateNodeBounds(leftIndex + 1, context.primBounds);
+		}
+		else
+		{
+			left.aabbMin = bestLeftBounds.min;
+			left.aabbMax = bestLeftBounds.max;
+			right.aabbMin = bestRightBounds.min;
+			right.aabbMax = bestRightBounds.max;
+		}
+
+		if (std::min(leftCount, count - leftCount) >= ParallelTaskThreshold && TakeTaskSlot(context.freeTaskSlots))
+		{
+			std::future<void> leftTask = std::async(std::launch::async, [this, leftIndex, &context, depth]
+				{
+					Subdivide(leftIndex, context, depth + 1);
+				});
+
+			Subdivide(leftIndex + 1, context, depth + 1);
+			leftTask.get();
+
+			++context.freeTaskSlots;
+		}
+		else
+		{
+			Subdivide(leftIndex, context, depth + 1);
+			Subdivide(leftIndex + 1, context, depth + 1);
+		}
+	}
+
+	void BVH4::Collapse(const BVH& bvh)
+	{
+		nodes.clear();
+
+		if (bvh.IsEmpty())
+			return;
+
+		nodes.emplace_back();
+		CollapseNode(bvh, 0, 0);
+	}
+
+	void BVH4::CollapseNode(const BVH& bvh, uint32_t binaryIndex, uint32_t wideIndex)
+	{
+		//Pull grandchildren up until the node is full, always opening the child with the largest surface
+		std::vector<uint32_t> candidates{};
+
+		const BVHNode& binaryNode = bvh.nodes[binaryIndex];
+		if (binaryNode.IsLeaf())
+		{
+			candidates.push_back(binaryIndex);
+		}
+		else
+		{
+			candidates.push_back(binaryNode.leftFirst);
+			candidates.push_back(binaryNode.leftFirst + 1);
+		}
+
+		while (candidates.size() < 4)
+		{
+			int bestCandidate = -1;
+			float bestArea = -1.f;
+
+			for (int i = 0; i < static_cast<int>(candidates.size()); ++i)
+			{
+				const BVHNode& candidate = bvh.nodes[candidates[i]];
+				if (candidate.IsLeaf())
+					continue;
+
+				const float area = AABB{ candidate.aabbMin, candidate.aabbMax }.HalfArea();
+				if (area > bestArea)
+				{
+					bestArea = area;
+					bestCandidate = i;
+				}
+			}
+
+			if (bestCandidate == -1)
+				break;
+
+			const uint32_t firstChild = bvh.nodes[candidates[bestCandidate]].leftFirst;
+			candidates[bestCandidate] = firstChild;
+			candidates.push_back(firstChild + 1);
+		}
+
+		for (int slot = 0; slot < 4; ++slot)
+		{
+			if (slot >= static_cast<int>(candidates.size()))
+			{
+				//Inverted box, fails the slab test for any ray direction
+				BVH4Node& node = nodes[wideIndex];
+				node.minX[slot] = node.minY[slot] = node.minZ[slot] = FLT_MAX;
+				node.maxX[slot] = node.maxY[slot] = node.maxZ[slot] = -FLT_MAX;
+				node.child[slot] = BVH4Node::EmptySlot;
+				node.count[slot] = 0;
+				continue;
+			}
+
+			const BVHNode& candidate = bvh.nodes[candidates[slot]];
+
+			uint32_t child = candidate.leftFirst;
+			if (!candidate.IsLeaf())
+			{
+				child = static_cast<uint32_t>(nodes.size());
+				nodes.emplace_back();
+				CollapseNode(bvh, candidates[slot], child);
+			}
+
+			//Re-fetch, the recursion above may have reallocated the node array
+			BVH4Node& node = nodes[wideIndex];
+			node.minX[slot] = candidate.aabbMin.x;
+			node.minY[slot] = candidate.aabbMin.y;
+			node.minZ[slot] = candidate.aabbMin.z;
+			node.maxX[slot] = candidate.aabbMax.x;
+			node.maxY[slot] = candidate.aabbMax.y;
+			node.maxZ[slot] = candidate.aabbMax.z;
+			node.child[slot] = child;
+			node.count[slot] = candidate.primCount;
+		}
+	}
+
+	void LightTree::Build(const std::vector<Vector3>& positions, const std::vector<float>& powers, const std::vector<float>& influenceRadiiSquared)
+	{
+		const uint32_t lightCount = static_cast<uint32_t>(positions.size());
+
+		nodes.clear();
+		lightIndices.resize(lightCount);
+		std::iota(lightIndices.begin(), lightIndices.end(), 0);
+
+		if (lightCount == 0)
+			return;
+
+		//One light per leaf, so exactly 2N - 1 nodes
+		nodes.resize(2 * static_cast<size_t>(lightCount) - 1);
+
+		LightTreeNode& root = nodes[0];
+		root.leftFirst = 0;
+		root.lightCount = lightCount;
+
+		uint32_t nodesUsed = 1;
+		Subdivide(0, nodesUsed, positions, powers, influenceRadiiSquared);
+	}
+
+	void LightTree::Subdivide(uint32_t nodeIndex, uint32_t& nodesUsed, const std::vector<Vector3>& positions, const std::vector<float>& powers,
+		const std::vector<float>& influenceRadiiSquared)
+	{
+		LightTreeNode& node = nodes[nodeIndex];
+		const uint32_t first = node.leftFirst;
+		const uint32_t count = node.lightCount;
+
+		AABB bounds{};
+		node.power = 0.f;
+		node.influenceRadiusSquared = 0.f;
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			bounds.Grow(positions[lightIndices[i]]);
+			node.power += powers[lightIndices[i]];
+			node.influenceRadiusSquared = std::max(node.influenceRadiusSquared, influenceRadiiSquared[lightIndices[i]]);
+		}
+		node.aabbMin = bounds.min;
+		node.aabbMax = bounds.max;
+		node.center = bounds.Center();
+		node.radiusSquared = ((bounds.max - bounds.min) * 0.5f).SqrMagnitude();
+
+		if (count == 1)
+			return;
+
+		const Vector3 extent = bounds.max - bounds.min;
+		int axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		const uint32_t leftCount = count / 2;
+		std::nth_element(lightIndices.begin() + first, lightIndices.begin() + first + leftCount, lightIndices.begin() + first + count,
+			[&](uint32_t a, uint32_t b) { return positions[a][axis] < positions[b][axis]; });
+
+		const uint32_t leftChild = nodesUsed;
+		nodesUsed += 2;
+
+		nodes[leftChild].leftFirst = first;
+		nodes[leftChild].lightCount = leftCount;
+		nodes[leftChild + 1].leftFirst = first + leftCount;
+		nodes[leftChild + 1].lightCount = count - leftCount;
+
+		node.leftFirst = leftChild;
+		node.lightCount = 0;
+
+		Subdivide(leftChild, nodesUsed, positions, powers, influenceRadiiSquared);
+		Subdivide(leftChild + 1, nodesUsed, positions, powers, influenceRadiiSquared);
+	}
+
+	float LightTree::GetImportance(const LightTreeNode& node, const Vector3& point)
+	{
+		//Spelled out per component, this runs for both children at every level of every sample
+
+		//Every light below is at least as far away as the bounds
+		const float outsideX = std::max({ node.aabbMin.x - point.x, point.x - node.aabbMax.x, 0.f });
+		const float outsideY = std::max({ node.aabbMin.y - point.y, point.y - node.aabbMax.y, 0.f });
+		const float outsideZ = std::max({ node.aabbMin.z - point.z, point.z - node.aabbMax.z, 0.f });
+		if (outsideX * outsideX + outsideY * outsideY + outsideZ * outsideZ > node.influenceRadiusSquared)
+			return 0.f;
+
+		const float toCenterX = point.x - node.center.x;
+		const float toCenterY = point.y - node.center.y;
+		const float toCenterZ = point.z - node.center.z;
+
+		const float distanceSquared = std::max({ toCenterX * toCenterX + toCenterY * toCenterY + toCenterZ * toCenterZ, node.radiusSquared, MinDistanceSquared });
+		return node.power / distanceSquared;
+	}
+
+	bool LightTree::Sample(const Vector3& point, float u, uint32_t& light, float& probability) const
+	{
+		if (nodes.empty())
+			return false;
+
+		//Largest float below 1, u is rescaled to [0, 1) again at every step
+		constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+
+		probability = 1.f;
+		uint32_t nodeIndex = 0;
+
+		while (!nodes[nodeIndex].IsLeaf())
+		{
+			const uint32_t leftChild = nodes[nodeIndex].leftFirst;
+			const float leftImportance = GetImportance(nodes[leftChild], point);
+			const float rightImportance = GetImportance(nodes[leftChild + 1], point);
+
+			const float totalImportance = leftImportance + rightImportance;
+			if (totalImportance <= 0.f)
+				return false;
+
+			const float leftProbability = leftImportance / totalImportance;
+			if (u < leftProbability || rightImportance <= 0.f)
+			{
+				u = std::min(u / leftProbability, OneMinusEpsilon);
+				probability *= leftProbability;
+				nodeIndex = leftChild;
+			}
+			else
+			{
+				const float rightProbability = rightImportance / totalImportance;
+				u = std::min((u - leftProbability) / rightProbability, OneMinusEpsilon);
+				probability *= rightProbability;
+				nodeIndex = leftChild + 1;
+			}
+		}
+
+		light = lightIndices[nodes[nodeIndex].leftFirst];
+		return true;
+	}
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+#pragma region AABB
+	struct AABB
+	{
+		Vector3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point)
+		{
+			min = Vector3::Min(min, point);
+			max = Vector3::Max(max, point);
+		}
+
+		void Grow(const AABB& other)
+		{
+			min = Vector3::Min(min, other.min);
+			max = Vector3::Max(max, other.max);
+		}
+
+		Vector3 Center() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		//Half of the surface area, the factor 2 cancels out in every SAH comparison
+		float HalfArea() const
+		{
+			const Vector3 extent = max - min;
+			return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+		}
+	};
+#pragma endregion
+
+#pragma region BVH
+	struct BVHNode
+	{
+		Vector3 aabbMin = {};
+		uint32_t leftFirst = {}; //Index of the left child (right = left + 1), or of the first primitive for leaves
+
+		Vector3 aabbMax = {};
+		uint32_t primCount = {}; //0 for interior nodes
+
+		bool IsLeaf() const { return primCount > 0; }
+	};
+
+	/**
+	 * \brief Binary bounding volume hierarchy over an arbitrary set of primitive bounds,
+	 * split using a binned surface area heuristic (SAH). The primitives themselves are never moved,
+	 * leaves reference them through primIndices.
+	 * Large subtrees are built as parallel tasks, large ranges are binned and partitioned in parallel.
+	 */
+	struct BVH
+	{
+		static constexpr uint32_t MaxLeafSize = 8;
+		//Below MaxSAHDepth nodes are halved along their longest axis, which takes fewer than 32 more levels for any primitive count.
+		//No tree is deeper than MaxDepth (the root at 0), so traversal stacks can be sized for it
+		static constexpr int MaxSAHDepth = 32;
+		static constexpr int MaxDepth = 64;
+		//Every step down leaves at most one sibling behind (packets push both children)
+		static constexpr int TraversalStackSize = MaxDepth + 1;
+		static constexpr float TraversalCost = 1.f;
+		static constexpr float IntersectionCost = 1.f;
+
+		static constexpr int BinCount = 16;
+		static constexpr uint32_t ParallelTaskThreshold = 4096; //Minimum primitives in a subtree to build it as a separate task
+		static constexpr uint32_t ParallelRangeThreshold = 65536; //Minimum primitives in a node to bin and partition it in parallel
+
+		std::vector<BVHNode> nodes = {};
+		std::vector<uint32_t> primIndices = {};
+
+		void Build(const std::vector<AABB>& primBounds);
+
+		//Recomputes the node bounds bottom-up, keeping the topology (primitive count must be unchanged)
+		void Refit(const std::vector<AABB>& primBounds);
+
+		bool IsEmpty() const { return nodes.empty(); }
+		uint32_t GetPrimCount() const { return static_cast<uint32_t>(primIndices.size()); }
+
+	private:
+		struct BuildContext;
+
+		void UpdateNodeBounds(uint32_t nodeIndex, const std::vector<AABB>& primBounds);
+		void Subdivide(uint32_t nodeIndex, BuildContext& context, int depth);
+	};
+#pragma endregion
+
+#pragma region BVH4
+	/**
+	 * \brief 4-wide node, the child boxes are stored as SoA so one SSE slab test checks all of them.
+	 * Leaves are not separate nodes: a child slot with count > 0 references primitives directly.
+	 */
+	struct alignas(16) BVH4Node
+	{
+		static constexpr uint32_t EmptySlot = UINT32_MAX;
+
+		float minX[4];
+		float minY[4];
+		float minZ[4];
+		float maxX[4];
+		float maxY[4];
+		float maxZ[4];
+
+		uint32_t child[4]; //Wide node index for interior children, first primitive (in primIndices) for leaves, unless remapped (see RemapLeaves)
+		uint32_t count[4]; //Primitive count for leaves, 0 for interior children and empty slots
+	};
+
+	/**
+	 * \brief Collapsed version of a binary BVH, every node holds up to 4 children.
+	 * Primitive ranges refer to the primIndices of the BVH it was collapsed from.
+	 */
+	struct BVH4
+	{
+		//Wide nodes only ever lie deeper than the binary node they were collapsed from, and every step down leaves at most 3 siblings behind
+		static constexpr int TraversalStackSize = 3 * BVH::MaxDepth + 1;
+
+		std::vector<BVH4Node> nodes = {};
+
+		void Collapse(const BVH& bvh);
+
+		//Points every leaf at something else, child becomes remapFunction(first, count) (e.g. the index of a primitive block)
+		template<typename RemapFunction>
+		void RemapLeaves(RemapFunction&& remapFunction)
+		{
+			for (BVH4Node& node : nodes)
+			{
+				for (int slot = 0; slot < 4; ++slot)
+				{
+					if (node.count[slot] > 0)
+						node.child[slot] = remapFunction(node.child[slot], node.count[slot]);
+				}
+			}
+		}
+
+		bool IsEmpty() const { return nodes.empty(); }
+
+	private:
+		void CollapseNode(const BVH& bvh, uint32_t binaryIndex, uint32_t wideIndex);
+	};
+#pragma endregion
+
+#pragma region LightTree
+	struct LightTreeNode
+	{
+		Vector3 aabbMin = {};
+		uint32_t leftFirst = {}; //Index of the left child (right = left + 1), or of the light (in lightIndices) for leaves
+
+		Vector3 aabbMax = {};
+		float power = {}; //Of every light below
+
+		Vector3 center = {}; //Of the bounds
+		float radiusSquared = {}; //Of the sphere around the bounds
+
+		float influenceRadiusSquared = {}; //Largest of the lights below, beyond it from the bounds none of them contributes
+		uint32_t lightCount = {}; //1 for leaves, 0 for interior nodes
+
+		bool IsLeaf() const { return lightCount > 0; }
+	};
+
+	/**
+	 * \brief Binary tree over point lights, every leaf one light, every node the bounds and total power of the lights below it.
+	 * Sample walks down from the root and picks a light for a shading point with a probability proportional to its importance,
+	 * so a few samples divided by their probability estimate the sum over every light without bias.
+	 * Nodes are split at the median of the longest axis, the lights themselves are never moved, leaves reference them through lightIndices.
+	 */
+	struct LightTree
+	{
+		static constexpr float MinDistanceSquared = 1e-4f; //Keeps the importance of a node finite at its lights
+
+		std::vector<LightTreeNode> nodes = {};
+		std::vector<uint32_t> lightIndices = {};
+
+		//power per light, lights without power are never picked. influenceRadiiSquared per light, lights are never picked
+		//for points farther away than that (infinity keeps a light everywhere)
+		void Build(const std::vector<Vector3>& positions, const std::vector<float>& powers, const std::vector<float>& influenceRadiiSquared);
+
+		//Picks a light for point, u in [0, 1) selects it. Returns false when no light can be picked
+		bool Sample(const Vector3& point, float u, uint32_t& light, float& probability) const;
+
+		bool IsEmpty() const { return nodes.empty(); }
+
+	private:
+		//Power over the squared distance to the center of the node, no closer than the node is large.
+		//0 when point lies beyond the influence radius of the bounds, that stays unbiased as none of the lights below contributes there
+		static float GetImportance(const LightTreeNode& node, const Vector3& point);
+
+		void Subdivide(uint32_t nodeIndex, uint32_t& nodesUsed, const std::vector<Vector3>& positions, const std::vector<float>& powers,
+			const std::vector<float>& influenceRadiiSquared);
+	};
+#pragma endregion
+}
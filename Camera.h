@@ -1,7 +1,6 @@
 #pragma once
 #include <cassert>
-#include <SDL_keyboard.h>
-#include <SDL_mouse.h>
+#include <cstdint>
 #include <iostream>
 
 #include "Math.h"
@@ -9,6 +8,20 @@
 
 namespace dae
 {
+	//Filled in by whoever owns the window, so the camera itself does not depend on one. Default: no input at all
+	struct CameraInput
+	{
+		bool moveForward = false;
+		bool moveBackward = false;
+		bool moveRight = false;
+		bool moveLeft = false;
+
+		int mouseX = 0; //Relative motion since the previous frame
+		int mouseY = 0;
+		bool isLeftMousePressed = false;
+		bool isRightMousePressed = false;
+	};
+
 	struct Camera
 	{
 		Camera() = default;
@@ -32,6 +45,8 @@ namespace dae
 
 		Matrix cameraToWorld = {};
 
+		CameraInput input = {}; //Applied by the next Update
+
 
 		Matrix CalculateCameraToWorld()
 		{
@@ -64,22 +79,20 @@ namespace dae
 			const Vector3 movementDirection{};
 
 			//Keyboard Input
-			const uint8_t* pKeyboardState = SDL_GetKeyboardState(nullptr);
-
-			if (pKeyboardState[SDL_SCANCODE_W])
+			if (input.moveForward)
 			{
 				origin += (step * deltaTime) * forward.Normalized();
 			}
-			if (pKeyboardState[SDL_SCANCODE_S])
+			if (input.moveBackward)
 			{
 				origin -= (step * deltaTime) * forward.Normalized();
 			}
-			if (pKeyboardState[SDL_SCANCODE_D])
+			if (input.moveRight)
 			{
 
 				origin += (step * deltaTime) * right.Normalized();
 			}
-			if (pKeyboardState[SDL_SCANCODE_A])
+			if (input.moveLeft)
 			{
 				origin -= (step * deltaTime) * right.Normalized();
 			}
@@ -87,15 +100,13 @@ namespace dae
 
 
 			//Mouse Input
-			int mouseX = 0, mouseY = 0;
-
-			const uint32_t mouseState = SDL_GetRelativeMouseState(&mouseX, &mouseY);
+			const int mouseX = input.mouseX, mouseY = input.mouseY;
 
 			const float rotationSpeed = 1.5f;
 
-			const bool isRightMousePressed{ mouseState == SDL_BUTTON_X1 };
-			const bool isLeftMousePressed{ mouseState == SDL_BUTTON_LEFT };
-			const bool areBothButtonsPressed{ mouseState == SDL_BUTTON_X2 };
+			const bool isRightMousePressed{ input.isRightMousePressed && !input.isLeftMousePressed };
+			const bool isLeftMousePressed{ input.isLeftMousePressed && !input.isRightMousePressed };
+			const bool areBothButtonsPressed{ input.isLeftMousePressed && input.isRightMousePressed };
 
 			//RMB + Mouse Move X
 
@@ -1,7 +1,12 @@
 #pragma once
 #include <cassert>
+#include <execution>
+#include <memory>
+#include <numeric>
+#include <span>
 
 #include "Math.h"
+#include "BVH.h"
 #include "vector"
 
 namespace dae
@@ -54,6 +59,85 @@ namespace dae
 		unsigned char materialIndex = {};
 	};
 
+	/**
+	 * \brief Up to 8 triangles prepared for Moller-Trumbore intersection, stored as SoA so one ray is tested against all of them at once.
+	 * Every BVH leaf of a mesh owns exactly one block. Unused lanes have a zero normal, which never passes the hit test.
+	 */
+	struct alignas(32) TriangleBlock
+	{
+		static constexpr uint32_t Size = 8;
+
+		float v0X[Size];
+		float v0Y[Size];
+		float v0Z[Size];
+
+		float edge1X[Size]; //v1 - v0
+		float edge1Y[Size];
+		float edge1Z[Size];
+
+		float edge2X[Size]; //v2 - v0
+		float edge2Y[Size];
+		float edge2Z[Size];
+
+		float normalX[Size]; //Normalized, object space
+		float normalY[Size];
+		float normalZ[Size];
+	};
+
+	/**
+	 * \brief SoA copy of up to 8 spheres, filled from Scene::m_SphereGeometries by the scene's sphere BVH (one block per leaf).
+	 * Unused lanes have a negative squared radius, which never passes the hit test.
+	 */
+	struct alignas(32) SphereBlock
+	{
+		static constexpr uint32_t Size = 8;
+
+		float originX[Size];
+		float originY[Size];
+		float originZ[Size];
+		float radiusSquared[Size];
+
+		uint32_t sphereIndex[Size]; //Index in the scene's sphere list
+	};
+
+	/**
+	 * \brief SoA copy of 8 consecutive planes of the scene, lane i of block b is plane b * Size + i.
+	 * Unused lanes have a zero normal, which never passes the hit test.
+	 */
+	struct alignas(32) PlaneBlock
+	{
+		static constexpr uint32_t Size = 8;
+
+		float originX[Size];
+		float originY[Size];
+		float originZ[Size];
+
+		float normalX[Size];
+		float normalY[Size];
+		float normalZ[Size];
+	};
+
+	static_assert(SphereBlock::Size == PlaneBlock::Size, "Scene tests both block types with the same distance buffer");
+
+	class MappedFile;
+
+	//Mesh data living in a memory-mapped cache file, the spans point straight into the mapping
+	struct MeshCacheView
+	{
+		std::shared_ptr<const MappedFile> pFile = {};
+
+		std::span<const Vector3> positions = {};
+		std::span<const Vector3> normals = {};
+		std::span<const int> indices = {};
+
+		std::span<const BVH4Node> bvhNodes = {};
+		std::span<const uint32_t> primIndices = {};
+		std::span<const TriangleBlock> triangleBlocks = {};
+
+		Vector3 minAABB = {};
+		Vector3 maxAABB = {};
+	};
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -91,8 +175,26 @@ namespace dae
 		Vector3 transformedMinAABB;
 		Vector3 transformedMaxAABB;
 
-		std::vector<Vector3> transformedPositions = {};
-		std::vector<Vector3> transformedNormals = {};
+		//Geometry and BVH stay in object space, rays are moved into object space at intersection time
+		Matrix worldTransform = {};
+		Matrix inverseTransform = {};
+		Matrix normalTransform = {}; //Inverse transpose, keeps normals perpendicular under non-uniform scale
+
+		BVH bvh = {};
+		BVH4 bvh4 = {}; //Collapsed from bvh, used for traversal
+
+		//One block per leaf, the leaves of bvh4 reference these instead of primIndices
+		std::vector<TriangleBlock> triangleBlocks = {};
+
+		//Set when the geometry and BVH are mapped from a cache file (see MeshCache.h), the vectors above then stay empty
+		std::shared_ptr<const MeshCacheView> pCache = {};
+
+		std::span<const Vector3> GetPositions() const { return pCache ? pCache->positions : std::span<const Vector3>{ positions }; }
+		std::span<const Vector3> GetNormals() const { return pCache ? pCache->normals : std::span<const Vector3>{ normals }; }
+		std::span<const int> GetIndices() const { return pCache ? pCache->indices : std::span<const int>{ indices }; }
+		std::span<const BVH4Node> GetBVHNodes() const { return pCache ? pCache->bvhNodes : std::span<const BVH4Node>{ bvh4.nodes }; }
+		std::span<const uint32_t> GetPrimIndices() const { return pCache ? pCache->primIndices : std::span<const uint32_t>{ bvh.primIndices }; }
+		std::span<const TriangleBlock> GetTriangleBlocks() const { return pCache ? pCache->triangleBlocks : std::span<const TriangleBlock>{ triangleBlocks }; }
 
 		void Translate(const Vector3& translation)
 		{
@@ -111,7 +213,12 @@ namespace dae
 
 		void UpdateAABB()
 		{
-			if (positions.size() > 0)
+			if (pCache)
+			{
+				minAABB = pCache->minAABB;
+				maxAABB = pCache->maxAABB;
+			}
+			else if (positions.size() > 0)
 			{
 				minAABB = positions[0];
 				maxAABB = positions[0];
@@ -152,7 +259,7 @@ namespace dae
 			tMinAABB = Vector3::Min(tAABB, tMinAABB);
 			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
 
-			tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
+			tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, maxAABB.z);
 			tMinAABB = Vector3::Min(tAABB, tMinAABB);
 			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
 
@@ -162,6 +269,8 @@ namespace dae
 
 		void AppendTriangle(const Triangle& triangle, bool ignoreTransformUpdate = false)
 		{
+			assert(!pCache && "Cached meshes are read-only");
+
 			int startIndex = static_cast<int>(positions.size());
 
 			positions.push_back(triangle.v0);
@@ -201,26 +310,79 @@ namespace dae
 
 		void UpdateTransforms()
 		{
+			//Geometry changed since the last build (new mesh, AppendTriangle, ...)
+			if (!pCache && bvh.GetPrimCount() != indices.size() / 3)
+			{
+				UpdateAABB();
+				UpdateBVH();
+			}
+
 			//Calculate Final Transform 
+			worldTransform = scaleTransform * rotationTransform * translationTransform;
+			inverseTransform = Matrix::Inverse(worldTransform);
+			normalTransform = Matrix::Transpose(inverseTransform);
 
-			const Matrix finalTransform = scaleTransform * rotationTransform * translationTransform;
+			UpdateTransformedAABB(worldTransform);
+		}
 
-			transformedPositions.clear();
-			transformedNormals.clear();
+		void UpdateBVH()
+		{
+			const size_t triangleCount = indices.size() / 3;
 
-			transformedPositions.reserve(positions.size());
-			transformedNormals.reserve(normals.size());
-			//Transform Positions (positions > transformedPositions)
-			for (const Vector3& pos : positions)
-			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(pos));
-			}
-			UpdateTransformedAABB(finalTransform);
-			//Transform Normals (normals > transformedNormals)
-			for (const Vector3& normal : normals)
-			{
-				transformedNormals.emplace_back(finalTransform.TransformVector(normal));
-			}
+			std::vector<AABB> triangleBounds(triangleCount);
+			std::vector<size_t> triangleIndices(triangleCount);
+			std::iota(triangleIndices.begin(), triangleIndices.end(), size_t{ 0 });
+
+			std::for_each(std::execution::par_unseq, triangleIndices.begin(), triangleIndices.end(), [this, &triangleBounds](size_t triangleIndex)
+				{
+					AABB& bounds = triangleBounds[triangleIndex];
+					bounds.Grow(positions[indices[triangleIndex * 3]]);
+					bounds.Grow(positions[indices[triangleIndex * 3 + 1]]);
+					bounds.Grow(positions[indices[triangleIndex * 3 + 2]]);
+				});
+
+			bvh.Build(triangleBounds);
+			bvh4.Collapse(bvh);
+
+			UpdateTriangleBlocks();
+		}
+
+		//Packs the triangles of every leaf into a block and points the leaf at it
+		void UpdateTriangleBlocks()
+		{
+			triangleBlocks.clear();
+
+			bvh4.RemapLeaves([this](uint32_t first, uint32_t count)
+				{
+					assert(count <= TriangleBlock::Size && "Leaves must fit in one block");
+
+					TriangleBlock& block = triangleBlocks.emplace_back(TriangleBlock{});
+
+					for (uint32_t lane = 0; lane < count; ++lane)
+					{
+						const uint32_t triangleIndex = bvh.primIndices[first + lane];
+
+						const Vector3& v0 = positions[indices[triangleIndex * 3]];
+						const Vector3 edge1 = positions[indices[triangleIndex * 3 + 1]] - v0;
+						const Vector3 edge2 = positions[indices[triangleIndex * 3 + 2]] - v0;
+						const Vector3 normal = normals[triangleIndex].Normalized();
+
+						block.v0X[lane] = v0.x;
+						block.v0Y[lane] = v0.y;
+						block.v0Z[lane] = v0.z;
+						block.edge1X[lane] = edge1.x;
+						block.edge1Y[lane] = edge1.y;
+						block.edge1Z[lane] = edge1.z;
+						block.edge2X[lane] = edge2.x;
+						block.edge2Y[lane] = edge2.y;
+						block.edge2Z[lane] = edge2.z;
+						block.normalX[lane] = normal.x;
+						block.normalY[lane] = normal.y;
+						block.normalZ[lane] = normal.z;
+					}
+
+					return static_cast<uint32_t>(triangleBlocks.size() - 1);
+				});
 		}
 	};
 #pragma endregion
@@ -259,6 +421,14 @@ namespace dae
 
 		bool didHit = false;
 		unsigned char materialIndex = 0;
+
+		//Object that was hit, only used to find geometric edges (anti-aliasing): kind of object in the top bits,
+		//index of the plane, sphere or mesh in the scene below. Set by the scene, not by GeometryUtils
+		uint32_t objectId = 0;
+
+		static constexpr uint32_t PlaneId = 1u << 30;
+		static constexpr uint32_t SphereId = 2u << 30;
+		static constexpr uint32_t TriangleMeshId = 3u << 30;
 	};
 #pragma endregion
 }
\ No newline at end of file
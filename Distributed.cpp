@@ -0,0 +1,824 @@
+#include "Distributed.h"
+#include "FrameBuffer.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Timer.h"
+#include "RayPacket.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <type_traits>
+
+using namespace dae;
+
+namespace
+{
+#pragma region Sockets
+#if defined(_WIN32)
+	constexpr intptr_t InvalidSocket = static_cast<intptr_t>(INVALID_SOCKET);
+	constexpr int SendFlags = 0;
+	constexpr int ShutdownBoth = SD_BOTH;
+
+	void InitializeSockets()
+	{
+		static const bool isInitialized = []
+			{
+				WSADATA data{};
+				return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+			}();
+		(void)isInitialized;
+	}
+
+	void CloseSocket(intptr_t socketHandle)
+	{
+		closesocket(static_cast<SOCKET>(socketHandle));
+	}
+#else
+	constexpr intptr_t InvalidSocket = -1;
+	constexpr int SendFlags = MSG_NOSIGNAL; //A worker that went away is an error to handle, not a SIGPIPE
+	constexpr int ShutdownBoth = SHUT_RDWR;
+
+	void InitializeSockets()
+	{
+	}
+
+	void CloseSocket(intptr_t socketHandle)
+	{
+		close(static_cast<int>(socketHandle));
+	}
+#endif
+
+	void ShutdownSocket(intptr_t socketHandle)
+	{
+		shutdown(socketHandle, ShutdownBoth);
+	}
+
+	//Tiles are small, don't let Nagle hold them back
+	void DisableNagle(intptr_t socketHandle)
+	{
+		const int isEnabled = 1;
+		setsockopt(socketHandle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&isEnabled), sizeof(isEnabled));
+	}
+
+	bool SendAll(intptr_t socketHandle, const uint8_t* pData, size_t size)
+	{
+		while (size > 0)
+		{
+			const auto sent = send(socketHandle, reinterpret_cast<const char*>(pData), static_cast<int>(std::min<size_t>(size, 1 << 20)), SendFlags);
+			if (sent <= 0)
+				return false;
+
+			pData += sent;
+			size -= sent;
+		}
+		return true;
+	}
+
+	bool ReceiveAll(intptr_t socketHandle, uint8_t* pData, size_t size)
+	{
+		while (size > 0)
+		{
+			const auto received = recv(socketHandle, reinterpret_cast<char*>(pData), static_cast<int>(std::min<size_t>(size, 1 << 20)), 0);
+			if (received <= 0)
+				return false;
+
+			pData += received;
+			size -= received;
+		}
+		return true;
+	}
+
+	intptr_t Listen(uint16_t port)
+	{
+		InitializeSockets();
+
+		const intptr_t socketHandle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (socketHandle == InvalidSocket)
+			return InvalidSocket;
+
+		const int reuseAddress = 1;
+		setsockopt(socketHandle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuseAddress), sizeof(reuseAddress));
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+
+		if (bind(socketHandle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+			listen(socketHandle, SOMAXCONN) != 0)
+		{
+			CloseSocket(socketHandle);
+			return InvalidSocket;
+		}
+
+		return socketHandle;
+	}
+
+	intptr_t Connect(const std::string& host, uint16_t port)
+	{
+		InitializeSockets();
+
+		addrinfo hints{};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		addrinfo* pAddresses = nullptr;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &pAddresses) != 0)
+			return InvalidSocket;
+
+		intptr_t socketHandle = InvalidSocket;
+		for (const addrinfo* pAddress = pAddresses; pAddress && socketHandle == InvalidSocket; pAddress = pAddress->ai_next)
+		{
+			socketHandle = socket(pAddress->ai_family, pAddress->ai_socktype, pAddress->ai_protocol);
+			if (socketHandle == InvalidSocket)
+				continue;
+
+			if (connect(socketHandle, pAddress->ai_addr, static_cast<int>(pAddress->ai_addrlen)) != 0)
+			{
+				CloseSocket(socketHandle);
+				socketHandle = InvalidSocket;
+			}
+		}
+
+		freeaddrinfo(pAddresses);
+		return socketHandle;
+	}
+#pragma endregion
+
+#pragma region Messages
+	enum class MessageType : uint32_t
+	{
+		Hello = 1,
+		Frame,
+		Tile,
+		Pixels,
+		Quit
+	};
+
+	constexpr uint32_t ProtocolMagic = 0x31575452; //"RTW1"
+	constexpr uint32_t ProtocolVersion = 3;
+	constexpr uint32_t MaxPayloadSize = 64 << 20;
+
+	class MessageWriter final
+	{
+	public:
+		template<typename T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			const auto* pBytes = reinterpret_cast<const uint8_t*>(&value);
+			m_Bytes.insert(m_Bytes.end(), pBytes, pBytes + sizeof(T));
+		}
+
+		void WriteString(const std::string& value)
+		{
+			Write(static_cast<uint32_t>(value.size()));
+			m_Bytes.insert(m_Bytes.end(), value.begin(), value.end());
+		}
+
+		void WriteBytes(const void* pData, size_t size)
+		{
+			const auto* pBytes = static_cast<const uint8_t*>(pData);
+			m_Bytes.insert(m_Bytes.end(), pBytes, pBytes + size);
+		}
+
+		//Header and payload in one go
+		bool Send(intptr_t socketHandle, MessageType type) const
+		{
+			uint32_t header[2]{ static_cast<uint32_t>(type), static_cast<uint32_t>(m_Bytes.size()) };
+
+			std::vector<uint8_t> message(sizeof(header) + m_Bytes.size());
+			std::memcpy(message.data(), header, sizeof(header));
+			std::copy(m_Bytes.begin(), m_Bytes.end(), message.begin() + sizeof(header));
+
+			return SendAll(socketHandle, message.data(), message.size());
+		}
+
+	private:
+		std::vector<uint8_t> m_Bytes{};
+	};
+
+	//Reads past the end of the payload give zeroes and make the reader invalid
+	class MessageReader final
+	{
+	public:
+		//Blocks until a whole message is in
+		bool Receive(intptr_t socketHandle)
+		{
+			uint32_t header[2]{};
+			if (!ReceiveAll(socketHandle, reinterpret_cast<uint8_t*>(header), sizeof(header)) || header[1] > MaxPayloadSize)
+				return false;
+
+			m_Type = static_cast<MessageType>(header[0]);
+			m_Bytes.resize(header[1]);
+			m_Offset = 0;
+			m_IsValid = true;
+
+			return ReceiveAll(socketHandle, m_Bytes.data(), m_Bytes.size());
+		}
+
+		MessageType GetType() const { return m_Type; }
+		bool IsValid() const { return m_IsValid && m_Offset <= m_Bytes.size(); }
+
+		template<typename T>
+		T Read()
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			T value{};
+			ReadBytes(&value, sizeof(T));
+			return value;
+		}
+
+		std::string ReadString()
+		{
+			const uint32_t size = Read<uint32_t>();
+			if (!m_IsValid || m_Bytes.size() - m_Offset < size)
+			{
+				m_IsValid = false;
+				return {};
+			}
+
+			std::string value(reinterpret_cast<const char*>(m_Bytes.data() + m_Offset), size);
+			m_Offset += size;
+			return value;
+		}
+
+		void ReadBytes(void* pData, size_t size)
+		{
+			if (!m_IsValid || m_Bytes.size() - m_Offset < size)
+			{
+				m_IsValid = false;
+				std::memset(pData, 0, size);
+				return;
+			}
+
+			std::memcpy(pData, m_Bytes.data() + m_Offset, size);
+			m_Offset += size;
+		}
+
+	private:
+		MessageType m_Type{};
+		std::vector<uint8_t> m_Bytes{};
+		size_t m_Offset = 0;
+		bool m_IsValid = false;
+	};
+
+	void WriteDescription(MessageWriter& writer, const FrameDescription& description)
+	{
+		writer.WriteString(description.sceneName);
+		writer.Write(description.time);
+		writer.Write(description.width);
+		writer.Write(description.height);
+		writer.Write(description.cameraOrigin);
+		writer.Write(description.cameraFovAngle);
+		writer.Write(description.cameraTotalPitch);
+		writer.Write(description.cameraTotalYaw);
+		writer.Write(static_cast<uint8_t>(description.shadows));
+		writer.Write(description.lightingMode);
+		writer.Write(description.lightCutoff);
+		writer.Write(description.lightSampleCount);
+	}
+
+	FrameDescription ReadDescription(MessageReader& reader)
+	{
+		FrameDescription description{};
+		description.sceneName = reader.ReadString();
+		description.time = reader.Read<float>();
+		description.width = reader.Read<uint32_t>();
+		description.height = reader.Read<uint32_t>();
+		description.cameraOrigin = reader.Read<Vector3>();
+		description.cameraFovAngle = reader.Read<float>();
+		description.cameraTotalPitch = reader.Read<float>();
+		description.cameraTotalYaw = reader.Read<float>();
+		description.shadows = reader.Read<uint8_t>() != 0;
+		description.lightingMode = reader.Read<uint32_t>();
+		description.lightCutoff = reader.Read<float>();
+		description.lightSampleCount = reader.Read<uint32_t>();
+		return description;
+	}
+#pragma endregion
+}
+
+#pragma region RenderCoordinator
+struct RenderCoordinator::Connection
+{
+	struct TileInFlight
+	{
+		uint32_t frameId;
+		uint32_t tileIndex;
+	};
+
+	intptr_t socket = InvalidSocket; //Only changed by the connection thread, under m_Mutex, invalid once closed
+	std::string name{};
+	std::thread thread{};
+
+	//Guarded by m_Mutex
+	bool isConnected = false; //Said hello and did not go away yet
+	std::deque<TileInFlight> tilesInFlight{}; //In the order the worker answers them
+	uint32_t renderedTileCount = 0; //That were used, over every frame
+};
+
+struct RenderCoordinator::Tile
+{
+	uint32_t x0, y0, x1, y1;
+	uint32_t copiesOut = 0; //Handed out and not back yet
+	bool isFinished = false;
+	bool wasReissued = false;
+};
+
+RenderCoordinator::RenderCoordinator(uint16_t port, uint32_t tileSize) :
+	m_TileSize((std::max(tileSize, 1u) + RayPacket::TileSize - 1) / RayPacket::TileSize * RayPacket::TileSize),
+	m_pFrameBuffer(std::make_unique<FrameBuffer>(1, 1)),
+	m_ListenSocket(Listen(port))
+{
+	if (m_ListenSocket != InvalidSocket)
+		m_AcceptThread = std::thread(&RenderCoordinator::AcceptConnections, this);
+}
+
+RenderCoordinator::~RenderCoordinator()
+{
+	{
+		std::lock_guard lock(m_Mutex);
+		m_IsShuttingDown = true;
+	}
+	m_Changed.notify_all();
+
+	//Connections still waiting for a hello or for tiles to come back would not notice otherwise, workers take it as Quit
+	{
+		std::lock_guard lock(m_Mutex);
+		for (const std::unique_ptr<Connection>& pConnection : m_Connections)
+		{
+			if (pConnection->socket != InvalidSocket)
+				ShutdownSocket(pConnection->socket);
+		}
+	}
+
+	//Unblocks accept
+	if (m_ListenSocket != InvalidSocket)
+	{
+		ShutdownSocket(m_ListenSocket);
+		CloseSocket(m_ListenSocket);
+	}
+
+	if (m_AcceptThread.joinable())
+		m_AcceptThread.join();
+
+	for (const std::unique_ptr<Connection>& pConnection : m_Connections)
+	{
+		pConnection->thread.join();
+		std::cout << "Worker " << pConnection->name << " rendered " << pConnection->renderedTileCount << " tiles" << std::endl;
+	}
+}
+
+bool RenderCoordinator::IsListening() const
+{
+	return m_ListenSocket != InvalidSocket;
+}
+
+uint32_t RenderCoordinator::GetWorkerCount() const
+{
+	std::lock_guard lock(m_Mutex);
+	return CountWorkers();
+}
+
+uint32_t RenderCoordinator::CountWorkers() const
+{
+	return static_cast<uint32_t>(std::count_if(m_Connections.begin(), m_Connections.end(),
+		[](const std::unique_ptr<Connection>& pConnection) { return pConnection->isConnected; }));
+}
+
+void RenderCoordinator::WaitForWorkers(uint32_t workerCount)
+{
+	std::unique_lock lock(m_Mutex);
+	m_Changed.wait(lock, [this, workerCount] { return CountWorkers() >= workerCount; });
+}
+
+bool RenderCoordinator::Render(const FrameDescription& description, float workerTimeout)
+{
+	std::unique_lock lock(m_Mutex);
+
+	if (m_pFrameBuffer->GetWidth() != description.width || m_pFrameBuffer->GetHeight() != description.height)
+		m_pFrameBuffer = std::make_unique<FrameBuffer>(description.width, description.height);
+
+	m_Tiles.clear();
+	for (uint32_t y0 = 0; y0 < description.height; y0 += m_TileSize)
+	{
+		for (uint32_t x0 = 0; x0 < description.width; x0 += m_TileSize)
+		{
+			m_Tiles.push_back({ x0, y0, std::min(x0 + m_TileSize, description.width), std::min(y0 + m_TileSize, description.height) });
+		}
+	}
+
+	m_Description = description;
+	m_NextTileIndex = 0;
+	m_FinishedTileCount = 0;
+	++m_FrameId;
+	m_IsFrameActive = true;
+	m_Changed.notify_all();
+
+	const auto isFinished = [this] { return m_FinishedTileCount == m_Tiles.size(); };
+	const std::chrono::duration<float> timeout{ workerTimeout };
+
+	bool isComplete = true;
+	while (!isFinished())
+	{
+		if (CountWorkers() > 0)
+		{
+			m_Changed.wait(lock);
+			continue;
+		}
+
+		//Every worker left, give new ones a while to connect before giving up on the frame
+		if (!m_Changed.wait_for(lock, timeout, [this, &isFinished] { return isFinished() || CountWorkers() > 0; }))
+		{
+			isComplete = false;
+			break;
+		}
+	}
+
+	m_IsFrameActive = false;
+	m_ReissuedTileRatio = std::count_if(m_Tiles.begin(), m_Tiles.end(), [](const Tile& tile) { return tile.wasReissued; }) /
+		static_cast<float>(m_Tiles.size());
+
+	return isComplete;
+}
+
+void RenderCoordinator::AcceptConnections()
+{
+	while (!m_IsShuttingDown)
+	{
+		sockaddr_in address{};
+		socklen_t addressSize = sizeof(address);
+
+		const intptr_t socketHandle = accept(m_ListenSocket, reinterpret_cast<sockaddr*>(&address), &addressSize);
+		if (socketHandle == InvalidSocket)
+			continue;
+
+		DisableNagle(socketHandle);
+
+		char host[INET_ADDRSTRLEN]{};
+		inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+
+		auto pConnection = std::make_unique<Connection>();
+		pConnection->socket = socketHandle;
+		pConnection->name = std::string(host) + ":" + std::to_string(ntohs(address.sin_port));
+
+		std::lock_guard lock(m_Mutex);
+		if (m_IsShuttingDown)
+		{
+			CloseSocket(socketHandle);
+			break;
+		}
+
+		Connection& connection = *pConnection;
+		m_Connections.push_back(std::move(pConnection));
+		connection.thread = std::thread(&RenderCoordinator::ServeConnection, this, std::ref(connection));
+	}
+}
+
+void RenderCoordinator::ServeConnection(Connection& connection)
+{
+	MessageReader reader{};
+
+	const bool isWorker = reader.Receive(connection.socket) && reader.GetType() == MessageType::Hello &&
+		reader.Read<uint32_t>() == ProtocolMagic && reader.Read<uint32_t>() == ProtocolVersion && reader.IsValid();
+
+	std::unique_lock lock(m_Mutex);
+
+	connection.isConnected = isWorker;
+	if (isWorker)
+	{
+		std::cout << "Worker " << connection.name << " connected" << std::endl;
+		m_Changed.notify_all();
+	}
+
+	uint32_t announcedFrameId = 0;
+	bool isConnected = isWorker;
+
+	while (isConnected && !m_IsShuttingDown)
+	{
+		//Messages are built under the lock, but sent and received without it
+		if (m_IsFrameActive && announcedFrameId != m_FrameId)
+		{
+			MessageWriter writer{};
+			writer.Write(m_FrameId);
+			WriteDescription(writer, m_Description);
+
+			announcedFrameId = m_FrameId;
+
+			lock.unlock();
+			isConnected = writer.Send(connection.socket, MessageType::Frame);
+			lock.lock();
+			continue;
+		}
+
+		uint32_t tileIndex = 0;
+		if (m_IsFrameActive && connection.tilesInFlight.size() < TilesInFlight && TakeTile(connection, tileIndex))
+		{
+			const Tile& tile = m_Tiles[tileIndex];
+
+			MessageWriter writer{};
+			writer.Write(m_FrameId);
+			writer.Write(tileIndex);
+			writer.Write(tile.x0);
+			writer.Write(tile.y0);
+			writer.Write(tile.x1);
+			writer.Write(tile.y1);
+
+			connection.tilesInFlight.push_back({ m_FrameId, tileIndex });
+
+			lock.unlock();
+			isConnected = writer.Send(connection.socket, MessageType::Tile);
+			lock.lock();
+			continue;
+		}
+
+		//Nothing to hand out, wait for a new frame or for a tile to be up for grabs again
+		if (connection.tilesInFlight.empty())
+		{
+			m_Changed.wait(lock);
+			continue;
+		}
+
+		lock.unlock();
+		isConnected = reader.Receive(connection.socket) && reader.GetType() == MessageType::Pixels;
+		lock.lock();
+
+		if (!isConnected)
+			break;
+
+		const Connection::TileInFlight tileInFlight = connection.tilesInFlight.front();
+		connection.tilesInFlight.pop_front();
+
+		const uint32_t frameId = reader.Read<uint32_t>();
+		const uint32_t answeredTileIndex = reader.Read<uint32_t>();
+		if (frameId != tileInFlight.frameId || answeredTileIndex != tileInFlight.tileIndex)
+		{
+			std::cout << "Worker " << connection.name << " answered another tile than it was sent" << std::endl;
+			isConnected = false;
+			break;
+		}
+
+		//A copy of a tile of a previous frame
+		if (frameId != m_FrameId)
+			continue;
+
+		Tile& tile = m_Tiles[answeredTileIndex];
+		--tile.copiesOut;
+
+		uint32_t rect[4]{};
+		reader.ReadBytes(rect, sizeof(rect));
+
+		if (tile.isFinished)
+			continue;
+
+		if (rect[0] != tile.x0 || rect[1] != tile.y0 || rect[2] != tile.x1 || rect[3] != tile.y1)
+		{
+			isConnected = false;
+			break;
+		}
+
+		uint32_t* pPixels = m_pFrameBuffer->GetPixels();
+		for (uint32_t y = tile.y0; y < tile.y1; ++y)
+		{
+			reader.ReadBytes(pPixels + tile.x0 + y * m_pFrameBuffer->GetWidth(), (tile.x1 - tile.x0) * sizeof(uint32_t));
+		}
+
+		if (!reader.IsValid())
+		{
+			isConnected = false;
+			break;
+		}
+
+		tile.isFinished = true;
+		++m_FinishedTileCount;
+		++connection.renderedTileCount;
+		m_Changed.notify_all();
+	}
+
+	//What it still had out is up for grabs again
+	for (const Connection::TileInFlight& tileInFlight : connection.tilesInFlight)
+	{
+		if (tileInFlight.frameId == m_FrameId)
+			--m_Tiles[tileInFlight.tileIndex].copiesOut;
+	}
+	connection.tilesInFlight.clear();
+
+	if (isWorker && !m_IsShuttingDown)
+		std::cout << "Worker " << connection.name << " disconnected" << std::endl;
+
+	connection.isConnected = false;
+	m_Changed.notify_all();
+
+	const intptr_t socketHandle = connection.socket;
+
+	lock.unlock();
+
+	if (isConnected)
+		MessageWriter{}.Send(socketHandle, MessageType::Quit);
+
+	//Closed under the lock, the destructor must never shut down a handle that was reused since
+	lock.lock();
+	ShutdownSocket(socketHandle);
+	CloseSocket(socketHandle);
+	connection.socket = InvalidSocket;
+}
+
+bool RenderCoordinator::TakeTile(const Connection& connection, uint32_t& tileIndex)
+{
+	if (m_NextTileIndex < m_Tiles.size())
+	{
+		tileIndex = m_NextTileIndex++;
+		++m_Tiles[tileIndex].copiesOut;
+		return true;
+	}
+
+	//Every tile was handed out: help with an unfinished one, the one with the fewest copies out, so lost tiles go first
+	const auto isInFlight = [&connection, this](uint32_t index)
+		{
+			return std::any_of(connection.tilesInFlight.begin(), connection.tilesInFlight.end(),
+				[this, index](const Connection::TileInFlight& tileInFlight) { return tileInFlight.frameId == m_FrameId && tileInFlight.tileIndex == index; });
+		};
+
+	bool isFound = false;
+	for (uint32_t index = 0; index < m_Tiles.size(); ++index)
+	{
+		const Tile& tile = m_Tiles[index];
+		if (tile.isFinished || isInFlight(index))
+			continue;
+
+		if (!isFound || tile.copiesOut < m_Tiles[tileIndex].copiesOut)
+		{
+			tileIndex = index;
+			isFound = true;
+		}
+	}
+
+	if (!isFound)
+		return false;
+
+	Tile& tile = m_Tiles[tileIndex];
+	tile.wasReissued = tile.wasReissued || tile.copiesOut > 0;
+	++tile.copiesOut;
+	return true;
+}
+#pragma endregion
+
+#pragma region RenderWorker
+RenderWorker::RenderWorker(uint32_t threadCount) :
+	m_ThreadCount(threadCount)
+{
+}
+
+RenderWorker::~RenderWorker() = default;
+
+bool RenderWorker::Run(const std::string& host, uint16_t port, float connectTimeout)
+{
+	//Workers may well be started before the coordinator
+	intptr_t socketHandle = InvalidSocket;
+	const auto startTime = std::chrono::steady_clock::now();
+	while ((socketHandle = Connect(host, port)) == InvalidSocket)
+	{
+		if (std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count() > connectTimeout)
+		{
+			std::cout << "Could not connect to " << host << ":" << port << std::endl;
+			return false;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+
+	DisableNagle(socketHandle);
+
+	MessageWriter hello{};
+	hello.Write(ProtocolMagic);
+	hello.Write(ProtocolVersion);
+	hello.Send(socketHandle, MessageType::Hello);
+
+	std::cout << "Connected to " << host << ":" << port << std::endl;
+
+	std::unique_ptr<Scene> pScene{};
+	std::unique_ptr<Renderer> pRenderer{};
+	FrameDescription description{};
+	uint32_t frameId = 0;
+
+	MessageReader reader{};
+	while (reader.Receive(socketHandle))
+	{
+		if (reader.GetType() == MessageType::Quit)
+			break;
+
+		if (reader.GetType() == MessageType::Frame)
+		{
+			frameId = reader.Read<uint32_t>();
+			const FrameDescription previousDescription = description;
+			description = ReadDescription(reader);
+
+			if (!reader.IsValid() || description.width == 0 || description.height == 0)
+				break;
+
+			if (!pScene || description.sceneName != previousDescription.sceneName)
+			{
+				pScene = Scene::Create(description.sceneName);
+				if (!pScene)
+				{
+					std::cout << "Unknown scene " << description.sceneName << std::endl;
+					break;
+				}
+
+				pScene->Initialize();
+			}
+
+			//Anything that is not per frame lives in the renderer, start over when it changes
+			if (!pRenderer ||
+				description.width != previousDescription.width || description.height != previousDescription.height ||
+				description.shadows != previousDescription.shadows || description.lightingMode != previousDescription.lightingMode ||
+				description.lightCutoff != previousDescription.lightCutoff || description.lightSampleCount != previousDescription.lightSampleCount)
+			{
+				pRenderer = std::make_unique<Renderer>(description.width, description.height, m_ThreadCount);
+
+				if (description.shadows)
+					pRenderer->ToggleShadows();
+				for (uint32_t i = 0; i < description.lightingMode; ++i)
+					pRenderer->CycleLightingMode();
+				pRenderer->SetLightCutoff(description.lightCutoff);
+				if (description.lightSampleCount > 0)
+				{
+					pRenderer->ToggleLightSampling();
+					pRenderer->SetLightSampleCount(description.lightSampleCount);
+				}
+			}
+
+			Camera& camera = pScene->GetCamera();
+			camera.origin = description.cameraOrigin;
+			camera.fovAngle = description.cameraFovAngle;
+			camera.totalPitch = description.cameraTotalPitch;
+			camera.totalYaw = description.cameraTotalYaw;
+
+			//A fresh timer, one fixed step ahead, reads description.time as its total time
+			Timer timer{};
+			timer.SetFixedTimeStep(description.time);
+			timer.Start();
+			if (description.time > 0.f)
+				timer.Update();
+
+			pScene->Update(&timer);
+			pScene->UpdateAccelerationStructure();
+			continue;
+		}
+
+		if (reader.GetType() != MessageType::Tile || !pRenderer)
+			break;
+
+		const uint32_t tileFrameId = reader.Read<uint32_t>();
+		const uint32_t tileIndex = reader.Read<uint32_t>();
+		uint32_t rect[4]{};
+		reader.ReadBytes(rect, sizeof(rect));
+
+		const auto [x0, y0, x1, y1] = rect;
+		if (!reader.IsValid() || tileFrameId != frameId || x0 >= x1 || y0 >= y1 || x1 > description.width || y1 > description.height)
+			break;
+
+		pRenderer->RenderRegion(pScene.get(), x0, y0, x1, y1);
+
+		MessageWriter pixels{};
+		pixels.Write(frameId);
+		pixels.Write(tileIndex);
+		pixels.WriteBytes(rect, sizeof(rect));
+
+		const FrameBuffer& frameBuffer = pRenderer->GetFrameBuffer();
+		for (uint32_t y = y0; y < y1; ++y)
+		{
+			pixels.WriteBytes(frameBuffer.GetPixels() + x0 + y * frameBuffer.GetWidth(), (x1 - x0) * sizeof(uint32_t));
+		}
+
+		if (!pixels.Send(socketHandle, MessageType::Pixels))
+			break;
+
+		++m_RenderedTileCount;
+	}
+
+	ShutdownSocket(socketHandle);
+	CloseSocket(socketHandle);
+	return true;
+}
+#pragma endregion
@@ -0,0 +1,143 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	class FrameBuffer;
+
+	/**
+	 * \brief Everything a worker needs to reproduce a frame: which scene, at what time, from where, and how it is shaded.
+	 * Scenes are built on the worker itself, by name (Scene::Create), so only this goes over the wire.
+	 */
+	struct FrameDescription
+	{
+		std::string sceneName{};
+		float time = 0.f; //Timer total time the scene is updated with
+		uint32_t width = 0;
+		uint32_t height = 0;
+
+		Vector3 cameraOrigin = {};
+		float cameraFovAngle = 90.f;
+		float cameraTotalPitch = 0.f;
+		float cameraTotalYaw = 0.f;
+
+		bool shadows = false;
+		uint32_t lightingMode = 0; //Times Renderer::CycleLightingMode is called
+		float lightCutoff = 0.f; //Renderer::SetLightCutoff
+		uint32_t lightSampleCount = 0; //Renderer::SetLightSampleCount, 0 shades every light
+	};
+
+	/**
+	 * \brief Coordinator of distributed rendering: listens for workers, splits every frame into tiles and hands them out.
+	 * Every connected worker has at most TilesInFlight tiles at a time, so faster workers come back for more sooner.
+	 * Once no tile is left, idle workers take tiles that are still out with others (fewest copies out first), the first
+	 * result wins. A slow or dead worker so never holds the frame up. Workers may connect and leave at any time.
+	 *
+	 * Protocol, over TCP, every message a {uint32_t type, uint32_t payload size} header and then its payload,
+	 * little endian as both ends are x86:
+	 *  worker -> coordinator  Hello   {uint32_t magic, uint32_t version}
+	 *  coordinator -> worker  Frame   {uint32_t frameId, FrameDescription}
+	 *  coordinator -> worker  Tile    {uint32_t frameId, uint32_t tileIndex, x0, y0, x1, y1}
+	 *  worker -> coordinator  Pixels  {uint32_t frameId, uint32_t tileIndex, x0, y0, x1, y1, (x1 - x0) * (y1 - y0) pixels}
+	 *  coordinator -> worker  Quit    {}
+	 * A worker answers every Tile with its Pixels, in order, for the last Frame it got.
+	 */
+	class RenderCoordinator final
+	{
+	public:
+		//tileSize is rounded up to a multiple of the packet size
+		RenderCoordinator(uint16_t port, uint32_t tileSize = 32);
+		~RenderCoordinator();
+
+		RenderCoordinator(const RenderCoordinator&) = delete;
+		RenderCoordinator(RenderCoordinator&&) noexcept = delete;
+		RenderCoordinator& operator=(const RenderCoordinator&) = delete;
+		RenderCoordinator& operator=(RenderCoordinator&&) noexcept = delete;
+
+		//False when the port could not be listened on
+		bool IsListening() const;
+		//Blocks until at least workerCount workers are connected
+		void WaitForWorkers(uint32_t workerCount);
+
+		//Blocks until every tile of the frame is back. Returns false, with the frame incomplete, when no worker was connected for workerTimeout seconds
+		bool Render(const FrameDescription& description, float workerTimeout = 10.f);
+		//Last rendered frame
+		const FrameBuffer& GetFrameBuffer() const { return *m_pFrameBuffer; }
+
+		//Tiles of the last Render that were handed out more than once, as a fraction of its tiles
+		float GetReissuedTileRatio() const { return m_ReissuedTileRatio; }
+		uint32_t GetWorkerCount() const;
+
+	private:
+		struct Connection;
+		struct Tile;
+
+		static constexpr uint32_t TilesInFlight = 2;
+
+		uint32_t m_TileSize;
+		std::unique_ptr<FrameBuffer> m_pFrameBuffer;
+		float m_ReissuedTileRatio = 0.f;
+
+		intptr_t m_ListenSocket;
+		std::thread m_AcceptThread;
+		std::atomic<bool> m_IsShuttingDown{ false };
+
+		//Guards everything below, the connection threads share the frame through it
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Changed;
+
+		std::vector<std::unique_ptr<Connection>> m_Connections;
+
+		uint32_t m_FrameId = 0; //Of the frame being rendered, 0 before the first
+		bool m_IsFrameActive = false;
+		FrameDescription m_Description{};
+		std::vector<Tile> m_Tiles;
+		uint32_t m_NextTileIndex = 0; //Tiles before it were handed out at least once
+		uint32_t m_FinishedTileCount = 0;
+
+		//Connections that said hello and did not go away yet. Call with m_Mutex locked
+		uint32_t CountWorkers() const;
+
+		void AcceptConnections();
+		void ServeConnection(Connection& connection);
+		//Next tile for connection, or false when there is none to hand out right now. Call with m_Mutex locked
+		bool TakeTile(const Connection& connection, uint32_t& tileIndex);
+	};
+
+	/**
+	 * \brief Worker side of distributed rendering: connects to a RenderCoordinator and renders the tiles it sends
+	 * with Renderer::RenderRegion, until the coordinator quits or goes away.
+	 */
+	class RenderWorker final
+	{
+	public:
+		//threadCount 0 uses every hardware thread
+		explicit RenderWorker(uint32_t threadCount = 0);
+		~RenderWorker();
+
+		RenderWorker(const RenderWorker&) = delete;
+		RenderWorker(RenderWorker&&) noexcept = delete;
+		RenderWorker& operator=(const RenderWorker&) = delete;
+		RenderWorker& operator=(RenderWorker&&) noexcept = delete;
+
+		//Retries connecting for connectTimeout seconds. Returns false when no coordinator could be reached
+		bool Run(const std::string& host, uint16_t port, float connectTimeout = 10.f);
+
+		uint32_t GetRenderedTileCount() const { return m_RenderedTileCount; }
+
+	private:
+		uint32_t m_ThreadCount;
+		uint32_t m_RenderedTileCount = 0;
+	};
+}
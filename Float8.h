@@ -0,0 +1,212 @@
+#pragma once
+#include <immintrin.h>
+
+namespace dae
+{
+#pragma region Float8
+	/**
+	 * \brief 8 floats operated on together, an AVX2 register or, without AVX2, two SSE halves.
+	 * Lets kernels over 8 lanes (e.g. the batched BRDFs in BRDFs.h) be written once for both code paths.
+	 */
+	struct Float8
+	{
+		static constexpr int Size = 8;
+
+#if defined(__AVX2__)
+		__m256 value;
+
+		static Float8 Set(float f) { return { _mm256_set1_ps(f) }; }
+		static Float8 Load(const float* pValues) { return { _mm256_load_ps(pValues) }; }
+		void Store(float* pValues) const { _mm256_store_ps(pValues, value); }
+
+		friend Float8 operator+(const Float8& a, const Float8& b) { return { _mm256_add_ps(a.value, b.value) }; }
+		friend Float8 operator-(const Float8& a, const Float8& b) { return { _mm256_sub_ps(a.value, b.value) }; }
+		friend Float8 operator*(const Float8& a, const Float8& b) { return { _mm256_mul_ps(a.value, b.value) }; }
+		friend Float8 operator/(const Float8& a, const Float8& b) { return { _mm256_div_ps(a.value, b.value) }; }
+
+		static Float8 Max(const Float8& a, const Float8& b) { return { _mm256_max_ps(a.value, b.value) }; }
+		static Float8 Min(const Float8& a, const Float8& b) { return { _mm256_min_ps(a.value, b.value) }; }
+		static Float8 Sqrt(const Float8& a) { return { _mm256_sqrt_ps(a.value) }; }
+
+		//Lanes with every bit set where a > b, 0 elsewhere, to mask with operator&
+		static Float8 GreaterThan(const Float8& a, const Float8& b) { return { _mm256_cmp_ps(a.value, b.value, _CMP_GT_OQ) }; }
+		friend Float8 operator&(const Float8& a, const Float8& b) { return { _mm256_and_ps(a.value, b.value) }; }
+
+		//To the nearest integer, ties to even
+		static Float8 Round(const Float8& a) { return { _mm256_cvtepi32_ps(_mm256_cvtps_epi32(a.value)) }; }
+
+		//Splits positive, normal lanes into mantissa [1, 2) * 2^exponent
+		static void Decompose(const Float8& a, Float8& mantissa, Float8& exponent)
+		{
+			const __m256i bits = _mm256_castps_si256(a.value);
+			mantissa = { _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000))) };
+			exponent = { _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127))) };
+		}
+
+		//2^a for integral lanes in [-126, 127], built straight from the exponent bits
+		static Float8 PowerOfTwo(const Float8& a)
+		{
+			return { _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(a.value), _mm256_set1_epi32(127)), 23)) };
+		}
+#else
+		__m128 low;
+		__m128 high;
+
+		static Float8 Set(float f) { return { _mm_set1_ps(f), _mm_set1_ps(f) }; }
+		static Float8 Load(const float* pValues) { return { _mm_load_ps(pValues), _mm_load_ps(pValues + 4) }; }
+		void Store(float* pValues) const { _mm_store_ps(pValues, low); _mm_store_ps(pValues + 4, high); }
+
+		friend Float8 operator+(const Float8& a, const Float8& b) { return { _mm_add_ps(a.low, b.low), _mm_add_ps(a.high, b.high) }; }
+		friend Float8 operator-(const Float8& a, const Float8& b) { return { _mm_sub_ps(a.low, b.low), _mm_sub_ps(a.high, b.high) }; }
+		friend Float8 operator*(const Float8& a, const Float8& b) { return { _mm_mul_ps(a.low, b.low), _mm_mul_ps(a.high, b.high) }; }
+		friend Float8 operator/(const Float8& a, const Float8& b) { return { _mm_div_ps(a.low, b.low), _mm_div_ps(a.high, b.high) }; }
+
+		static Float8 Max(const Float8& a, const Float8& b) { return { _mm_max_ps(a.low, b.low), _mm_max_ps(a.high, b.high) }; }
+		static Float8 Min(const Float8& a, const Float8& b) { return { _mm_min_ps(a.low, b.low), _mm_min_ps(a.high, b.high) }; }
+		static Float8 Sqrt(const Float8& a) { return { _mm_sqrt_ps(a.low), _mm_sqrt_ps(a.high) }; }
+
+		//Lanes with every bit set where a > b, 0 elsewhere, to mask with operator&
+		static Float8 GreaterThan(const Float8& a, const Float8& b) { return { _mm_cmpgt_ps(a.low, b.low), _mm_cmpgt_ps(a.high, b.high) }; }
+		friend Float8 operator&(const Float8& a, const Float8& b) { return { _mm_and_ps(a.low, b.low), _mm_and_ps(a.high, b.high) }; }
+
+		//To the nearest integer, ties to even
+		static Float8 Round(const Float8& a)
+		{
+			return { _mm_cvtepi32_ps(_mm_cvtps_epi32(a.low)), _mm_cvtepi32_ps(_mm_cvtps_epi32(a.high)) };
+		}
+
+		//Splits positive, normal lanes into mantissa [1, 2) * 2^exponent
+		static void Decompose(const Float8& a, Float8& mantissa, Float8& exponent)
+		{
+			const auto decompose = [](__m128 half, __m128& halfMantissa, __m128& halfExponent)
+				{
+					const __m128i bits = _mm_castps_si128(half);
+					halfMantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+					halfExponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+				};
+
+			decompose(a.low, mantissa.low, exponent.low);
+			decompose(a.high, mantissa.high, exponent.high);
+		}
+
+		//2^a for integral lanes in [-126, 127], built straight from the exponent bits
+		static Float8 PowerOfTwo(const Float8& a)
+		{
+			const auto powerOfTwo = [](__m128 half)
+				{
+					return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(half), _mm_set1_epi32(127)), 23));
+				};
+
+			return { powerOfTwo(a.low), powerOfTwo(a.high) };
+		}
+#endif
+
+		//log2 of positive, normal lanes, within a few ulp of log2f (the Cephes logf polynomial)
+		static Float8 Log2(const Float8& a)
+		{
+			Float8 mantissa;
+			Float8 exponent;
+			Decompose(a, mantissa, exponent);
+
+			//Halve mantissas above sqrt(2), the polynomial is only accurate around 1
+			const Float8 isHalved = GreaterThan(mantissa, Set(1.41421356f));
+			mantissa = mantissa * (Set(1.f) - (isHalved & Set(0.5f)));
+			exponent = exponent + (isHalved & Set(1.f));
+
+			const Float8 x = mantissa - Set(1.f);
+			const Float8 xSquared = x * x;
+
+			Float8 polynomial = Set(7.0376836292e-2f);
+			polynomial = polynomial * x + Set(-1.1514610310e-1f);
+			polynomial = polynomial * x + Set(1.1676998740e-1f);
+			polynomial = polynomial * x + Set(-1.2420140846e-1f);
+			polynomial = polynomial * x + Set(1.4249322787e-1f);
+			polynomial = polynomial * x + Set(-1.6668057665e-1f);
+			polynomial = polynomial * x + Set(2.0000714765e-1f);
+			polynomial = polynomial * x + Set(-2.4999993993e-1f);
+			polynomial = polynomial * x + Set(3.3333331174e-1f);
+
+			const Float8 naturalLog = x + polynomial * xSquared * x - Set(0.5f) * xSquared;
+			return naturalLog * Set(1.44269504f) + exponent;
+		}
+
+		//2^a, clamped to the normal range (the Cephes exp2f polynomial)
+		static Float8 Exp2(const Float8& a)
+		{
+			const Float8 clamped = Min(Max(a, Set(-126.f)), Set(127.f));
+			const Float8 integral = Round(clamped);
+			const Float8 x = clamped - integral;
+
+			Float8 polynomial = Set(1.535336188319500e-4f);
+			polynomial = polynomial * x + Set(1.339887440266574e-3f);
+			polynomial = polynomial * x + Set(9.618437357674640e-3f);
+			polynomial = polynomial * x + Set(5.550332471162809e-2f);
+			polynomial = polynomial * x + Set(2.402264791363012e-1f);
+			polynomial = polynomial * x + Set(6.931472028550421e-1f);
+
+			return (Set(1.f) + polynomial * x) * PowerOfTwo(integral);
+		}
+
+		//a^b for b > 0, 0 where a is not positive
+		static Float8 Pow(const Float8& a, const Float8& b)
+		{
+			return Exp2(b * Log2(a)) & GreaterThan(a, Set(0.f));
+		}
+	};
+#pragma endregion
+
+#pragma region Vector3x8
+	//8 vectors, SoA
+	struct Vector3x8
+	{
+		Float8 x;
+		Float8 y;
+		Float8 z;
+
+		static Vector3x8 Load(const float* pX, const float* pY, const float* pZ)
+		{
+			return { Float8::Load(pX), Float8::Load(pY), Float8::Load(pZ) };
+		}
+
+		static Float8 Dot(const Vector3x8& a, const Vector3x8& b)
+		{
+			return a.x * b.x + a.y * b.y + a.z * b.z;
+		}
+
+		friend Vector3x8 operator+(const Vector3x8& a, const Vector3x8& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+		friend Vector3x8 operator-(const Vector3x8& a, const Vector3x8& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+		friend Vector3x8 operator*(const Float8& s, const Vector3x8& v) { return { s * v.x, s * v.y, s * v.z }; }
+		friend Vector3x8 operator/(const Vector3x8& v, const Float8& s) { return { v.x / s, v.y / s, v.z / s }; }
+
+		Float8 Magnitude() const { return Float8::Sqrt(Dot(*this, *this)); }
+	};
+#pragma endregion
+
+#pragma region ColorRGBx8
+	//8 colors, SoA
+	struct ColorRGBx8
+	{
+		Float8 r;
+		Float8 g;
+		Float8 b;
+
+		static ColorRGBx8 Set(float r, float g, float b)
+		{
+			return { Float8::Set(r), Float8::Set(g), Float8::Set(b) };
+		}
+
+		void Store(float* pR, float* pG, float* pB) const
+		{
+			r.Store(pR);
+			g.Store(pG);
+			b.Store(pB);
+		}
+
+		friend ColorRGBx8 operator+(const ColorRGBx8& a, const ColorRGBx8& c) { return { a.r + c.r, a.g + c.g, a.b + c.b }; }
+		friend ColorRGBx8 operator-(const ColorRGBx8& a, const ColorRGBx8& c) { return { a.r - c.r, a.g - c.g, a.b - c.b }; }
+		friend ColorRGBx8 operator*(const ColorRGBx8& a, const ColorRGBx8& c) { return { a.r * c.r, a.g * c.g, a.b * c.b }; }
+		friend ColorRGBx8 operator*(const ColorRGBx8& c, const Float8& s) { return { c.r * s, c.g * s, c.b * s }; }
+		friend ColorRGBx8 operator/(const ColorRGBx8& c, const Float8& s) { return { c.r / s, c.g / s, c.b / s }; }
+	};
+#pragma endregion
+}
@@ -0,0 +1,105 @@
+#include "FrameBuffer.h"
+
+#include <fstream>
+
+using namespace dae;
+
+namespace
+{
+	void WriteLittleEndian(std::ofstream& file, uint32_t value, uint32_t byteCount)
+	{
+		for (uint32_t i = 0; i < byteCount; ++i)
+		{
+			file.put(static_cast<char>(value >> (i * 8) & 0xFF));
+		}
+	}
+}
+
+FrameBuffer::FrameBuffer(uint32_t width, uint32_t height) :
+	m_Width(width),
+	m_Height(height),
+	m_Pixels(static_cast<size_t>(width) * height, PackPixel(0, 0, 0))
+{
+}
+
+bool FrameBuffer::SaveToImage(const std::string& filename) const
+{
+	const size_t extensionStart = filename.find_last_of('.');
+	if (extensionStart != std::string::npos && filename.compare(extensionStart, std::string::npos, ".ppm") == 0)
+		return SaveToPPM(filename);
+
+	return SaveToBMP(filename);
+}
+
+bool FrameBuffer::SaveToPPM(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+
+	file << "P6 " << m_Width << " " << m_Height << " 255\n";
+
+	std::vector<char> row(m_Width * 3);
+	for (uint32_t y = 0; y < m_Height; ++y)
+	{
+		for (uint32_t x = 0; x < m_Width; ++x)
+		{
+			const uint32_t pixel = m_Pixels[x + (y * m_Width)];
+			row[x * 3] = static_cast<char>(pixel >> 16);
+			row[x * 3 + 1] = static_cast<char>(pixel >> 8);
+			row[x * 3 + 2] = static_cast<char>(pixel);
+		}
+
+		file.write(row.data(), row.size());
+	}
+
+	return static_cast<bool>(file);
+}
+
+bool FrameBuffer::SaveToBMP(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+
+	//Rows are padded to 4 bytes and stored bottom to top
+	const uint32_t rowSize = (m_Width * 3 + 3) & ~3u;
+	const uint32_t headerSize = 14 + 40;
+	const uint32_t imageSize = rowSize * m_Height;
+
+	//BITMAPFILEHEADER
+	file.put('B');
+	file.put('M');
+	WriteLittleEndian(file, headerSize + imageSize, 4);
+	WriteLittleEndian(file, 0, 4);
+	WriteLittleEndian(file, headerSize, 4);
+
+	//BITMAPINFOHEADER
+	WriteLittleEndian(file, 40, 4);
+	WriteLittleEndian(file, m_Width, 4);
+	WriteLittleEndian(file, m_Height, 4);
+	WriteLittleEndian(file, 1, 2); //Planes
+	WriteLittleEndian(file, 24, 2); //Bits per pixel
+	WriteLittleEndian(file, 0, 4); //Uncompressed
+	WriteLittleEndian(file, imageSize, 4);
+	WriteLittleEndian(file, 2835, 4); //72 DPI
+	WriteLittleEndian(file, 2835, 4);
+	WriteLittleEndian(file, 0, 4);
+	WriteLittleEndian(file, 0, 4);
+
+	std::vector<char> row(rowSize, 0);
+	for (uint32_t y = m_Height; y-- > 0;)
+	{
+		for (uint32_t x = 0; x < m_Width; ++x)
+		{
+			const uint32_t pixel = m_Pixels[x + (y * m_Width)];
+			row[x * 3] = static_cast<char>(pixel);
+			row[x * 3 + 1] = static_cast<char>(pixel >> 8);
+			row[x * 3 + 2] = static_cast<char>(pixel >> 16);
+		}
+
+		file.write(row.data(), row.size());
+	}
+
+	return static_cast<bool>(file);
+}
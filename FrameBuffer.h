@@ -0,0 +1,40 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	/**
+	 * \brief Plain in-memory render target, independent of any window or display.
+	 * Pixels are 32 bit 0xAARRGGBB (SDL_PIXELFORMAT_ARGB8888), rows top to bottom without padding.
+	 */
+	class FrameBuffer final
+	{
+	public:
+		FrameBuffer(uint32_t width, uint32_t height);
+
+		static uint32_t PackPixel(uint8_t r, uint8_t g, uint8_t b)
+		{
+			return 0xFF000000u | static_cast<uint32_t>(r) << 16 | static_cast<uint32_t>(g) << 8 | b;
+		}
+
+		uint32_t GetWidth() const { return m_Width; }
+		uint32_t GetHeight() const { return m_Height; }
+		uint32_t* GetPixels() { return m_Pixels.data(); }
+		const uint32_t* GetPixels() const { return m_Pixels.data(); }
+
+		//Binary PPM for a .ppm extension, 24 bit BMP otherwise. Returns false when the file could not be written
+		bool SaveToImage(const std::string& filename) const;
+
+	private:
+		uint32_t m_Width;
+		uint32_t m_Height;
+		std::vector<uint32_t> m_Pixels;
+
+		bool SaveToPPM(const std::string& filename) const;
+		bool SaveToBMP(const std::string& filename) const;
+	};
+}
@@ -0,0 +1,748 @@
+//Offline renderer: no window, no display, renders a fixed number of frames and writes them to image files.
+//This is the executable benchmarks run against, run it without arguments for the options
+
+//Standard includes
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Project includes
+#include "Timer.h"
+#include "Distributed.h"
+#include "FrameBuffer.h"
+#include "Material.h"
+#include "Renderer.h"
+#include "Scene.h"
+
+using namespace dae;
+
+namespace
+{
+	struct Options
+	{
+		std::string sceneName = "reference";
+		uint32_t width = 640;
+		uint32_t height = 480;
+		uint32_t frameCount = 1;
+		uint32_t warmupFrameCount = 0;
+		std::string outputPath = "RayTracing_Buffer.bmp";
+		std::string benchmarkPath = {};
+		float timeStep = 1.f / 30.f;
+
+		uint32_t threadCount = 0;
+		uint32_t tileSize = 32;
+
+		bool shadows = false;
+		bool packets = true;
+		bool pipeline = false;
+		bool progressive = false;
+		bool antiAliasing = false;
+		bool dirtyRegions = true;
+		bool wavefront = false;
+		bool batchedShading = true;
+		uint32_t temporalMode = 0; //Times CycleTemporalMode is called
+		uint32_t lightingMode = 0; //Times CycleLightingMode is called
+		float lightCutoff = 0.f;
+		uint32_t lightSampleCount = 0; //0 shades every light
+
+		//Distributed rendering, see Distributed.h
+		uint16_t coordinatorPort = 0;
+		uint32_t workerCount = 1;
+		std::string workerHost = {};
+		uint16_t workerPort = 0;
+
+		uint32_t brdfBenchmarkPairCount = 0; //Only benchmarks the BRDFs when not 0
+		uint32_t lightBenchmarkFrameCount = 0; //Only benchmarks light sampling when not 0
+	};
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"Usage: RayTracerCLI [options]\n"
+			"  --scene <name>                        reference, bunny, lowpolyman or manylights (reference)\n"
+			"  --width <pixels> --height <pixels>    resolution (640 x 480)\n"
+			"  --frames <count>                      frames to render and time (1)\n"
+			"  --warmup <count>                      frames rendered before timing starts (0)\n"
+			"  --time-step <seconds>                 animation time between frames (0.0333)\n"
+			"  --output <path>                       image of the last frame, .ppm or .bmp (RayTracing_Buffer.bmp)\n"
+			"                                        '#'s are replaced by the frame number and write every frame\n"
+			"  --benchmark <path>                    also write the timings to this file\n"
+			"  --threads <count>                     0 uses every hardware thread (0)\n"
+			"  --tile-size <pixels>                  (32)\n"
+			"  --shadows --no-packets --pipeline --progressive --anti-aliasing --no-dirty-regions\n"
+			"  --wavefront --scalar-shading          wavefront rendering, with the scalar rather than the batched BRDFs\n"
+			"  --temporal <off|reuse|taa>            temporal reprojection (off)\n"
+			"  --lighting <combined|area|radiance|brdf>\n"
+			"  --light-cutoff <radiance>             ignore point lights where their radiance drops below this, 0 keeps them all (0)\n"
+			"                                        only applies to the combined and radiance lighting modes\n"
+			"  --light-samples <count>               shade count point lights per hit picked from a light tree, 0 shades every light (0)\n"
+			"Distributed rendering, one sample per pixel without progressive, anti-aliasing or temporal passes:\n"
+			"  --coordinator <port>                  hand the tiles of every frame out to workers connecting on port\n"
+			"  --workers <count>                     workers to wait for before the first frame (1)\n"
+			"  --worker <host:port>                  render tiles for that coordinator, only --threads applies\n"
+			"Kernels:\n"
+			"  --brdf-benchmark <pairs>              time the scalar against the batched BRDFs on random (pixel, light) pairs\n"
+			"  --light-benchmark <frames>            time to error of light sampling against shading every light, averaging up to frames frames\n";
+	}
+
+	//Returns false on unknown or incomplete arguments
+	bool ParseOptions(int argc, char* args[], Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string argument = args[i];
+			const bool hasValue = i + 1 < argc;
+
+			if (argument == "--shadows")
+				options.shadows = true;
+			else if (argument == "--no-packets")
+				options.packets = false;
+			else if (argument == "--pipeline")
+				options.pipeline = true;
+			else if (argument == "--progressive")
+				options.progressive = true;
+			else if (argument == "--anti-aliasing")
+				options.antiAliasing = true;
+			else if (argument == "--no-dirty-regions")
+				options.dirtyRegions = false;
+			else if (argument == "--wavefront")
+				options.wavefront = true;
+			else if (argument == "--scalar-shading")
+				options.batchedShading = false;
+			else if (!hasValue)
+				return false;
+			else
+			{
+				const std::string value = args[++i];
+
+				if (argument == "--scene")
+					options.sceneName = value;
+				else if (argument == "--width")
+					options.width = std::stoul(value);
+				else if (argument == "--height")
+					options.height = std::stoul(value);
+				else if (argument == "--frames")
+					options.frameCount = std::stoul(value);
+				else if (argument == "--warmup")
+					options.warmupFrameCount = std::stoul(value);
+				else if (argument == "--time-step")
+					options.timeStep = std::stof(value);
+				else if (argument == "--output")
+					options.outputPath = value;
+				else if (argument == "--benchmark")
+					options.benchmarkPath = value;
+				else if (argument == "--threads")
+					options.threadCount = std::stoul(value);
+				else if (argument == "--tile-size")
+					options.tileSize = std::stoul(value);
+				else if (argument == "--coordinator")
+					options.coordinatorPort = static_cast<uint16_t>(std::stoul(value));
+				else if (argument == "--workers")
+					options.workerCount = std::stoul(value);
+				else if (argument == "--light-cutoff")
+					options.lightCutoff = std::stof(value);
+				else if (argument == "--light-samples")
+					options.lightSampleCount = std::stoul(value);
+				else if (argument == "--light-benchmark")
+					options.lightBenchmarkFrameCount = std::stoul(value);
+				else if (argument == "--brdf-benchmark")
+					options.brdfBenchmarkPairCount = std::stoul(value);
+				else if (argument == "--worker")
+				{
+					const size_t separator = value.find_last_of(':');
+					if (separator == std::string::npos)
+						return false;
+
+					options.workerHost = value.substr(0, separator);
+					options.workerPort = static_cast<uint16_t>(std::stoul(value.substr(separator + 1)));
+				}
+				else if (argument == "--temporal")
+				{
+					const std::vector<std::string> modes{ "off", "reuse", "taa" };
+					const auto it = std::find(modes.begin(), modes.end(), value);
+					if (it == modes.end())
+						return false;
+
+					options.temporalMode = static_cast<uint32_t>(it - modes.begin());
+				}
+				else if (argument == "--lighting")
+				{
+					const std::vector<std::string> modes{ "combined", "area", "radiance", "brdf" };
+					const auto it = std::find(modes.begin(), modes.end(), value);
+					if (it == modes.end())
+						return false;
+
+					options.lightingMode = static_cast<uint32_t>(it - modes.begin());
+				}
+				else
+					return false;
+			}
+		}
+
+		//Workers only render single samples of whole frames
+		if (options.coordinatorPort != 0 && (options.pipeline || options.progressive || options.antiAliasing || options.temporalMode != 0))
+			return false;
+
+		return options.width > 0 && options.height > 0 && options.frameCount > 0;
+	}
+
+	//Replaces the run of '#'s in path with the zero padded frame number
+	std::string GetFramePath(const std::string& path, uint32_t frameIndex)
+	{
+		const size_t first = path.find('#');
+		if (first == std::string::npos)
+			return path;
+
+		const size_t last = path.find_first_not_of('#', first);
+		const size_t digitCount = (last == std::string::npos ? path.size() : last) - first;
+
+		std::string number = std::to_string(frameIndex);
+		if (number.size() < digitCount)
+			number.insert(0, digitCount - number.size(), '0');
+
+		return path.substr(0, first) + number + (last == std::string::npos ? std::string{} : path.substr(last));
+	}
+
+	struct FrameStats
+	{
+		float frameTime; //ms, wall clock from the start of the frame until it is finished
+		float samplesPerPixel;
+		float loadImbalance;
+		float reusedPixelRatio;
+		float dirtyTileRatio;
+		float reissuedTileRatio;
+		float tileLightRatio;
+	};
+
+	//8 random (pixel, light) pairs, SoA like the batches the renderer shades
+	struct alignas(32) BRDFPairBlock
+	{
+		float normalX[Float8::Size], normalY[Float8::Size], normalZ[Float8::Size];
+		float lightX[Float8::Size], lightY[Float8::Size], lightZ[Float8::Size];
+		float viewX[Float8::Size], viewY[Float8::Size], viewZ[Float8::Size];
+	};
+
+	//Times ShadeMaterial against ShadeMaterial8 per material type, on directions in the hemisphere of the normal
+	void RunBRDFBenchmark(uint32_t pairCount)
+	{
+		std::mt19937 generator{ 42 };
+		std::normal_distribution<float> distribution{};
+
+		const auto randomDirection = [&]()
+			{
+				return Vector3{ distribution(generator), distribution(generator), distribution(generator) }.Normalized();
+			};
+
+		std::vector<BRDFPairBlock> blocks((pairCount + Float8::Size - 1) / Float8::Size);
+		for (BRDFPairBlock& block : blocks)
+		{
+			for (int lane = 0; lane < Float8::Size; ++lane)
+			{
+				const Vector3 normal = randomDirection();
+				Vector3 l = randomDirection();
+				Vector3 v = randomDirection();
+				if (Vector3::Dot(normal, l) < 0.f)
+					l = -l;
+				if (Vector3::Dot(normal, v) < 0.f)
+					v = -v;
+
+				block.normalX[lane] = normal.x; block.normalY[lane] = normal.y; block.normalZ[lane] = normal.z;
+				block.lightX[lane] = l.x; block.lightY[lane] = l.y; block.lightZ[lane] = l.z;
+				block.viewX[lane] = v.x; block.viewY[lane] = v.y; block.viewZ[lane] = v.z;
+			}
+		}
+
+		const size_t laneCount = blocks.size() * Float8::Size;
+		std::vector<ColorRGB> scalarColors(laneCount);
+		std::vector<ColorRGB> batchedColors(laneCount);
+
+		//Best of a few runs, in ns per pair
+		const auto time = [&](auto&& kernel)
+			{
+				constexpr int runCount = 5;
+				float bestTime = FLT_MAX;
+				for (int run = 0; run < runCount; ++run)
+				{
+					const auto start = std::chrono::steady_clock::now();
+					kernel();
+					const std::chrono::duration<float, std::nano> duration = std::chrono::steady_clock::now() - start;
+					bestTime = std::min(bestTime, duration.count() / static_cast<float>(laneCount));
+				}
+				return bestTime;
+			};
+
+		const auto benchmark = [&](const char* name, auto materialType, const Material& material)
+			{
+				constexpr MaterialType type = decltype(materialType)::value;
+
+				const float scalarTime = time([&]()
+					{
+						for (size_t blockIndex = 0; blockIndex < blocks.size(); ++blockIndex)
+						{
+							const BRDFPairBlock& block = blocks[blockIndex];
+							for (int lane = 0; lane < Float8::Size; ++lane)
+							{
+								HitRecord hitRecord{};
+								hitRecord.normal = { block.normalX[lane], block.normalY[lane], block.normalZ[lane] };
+								const Vector3 l{ block.lightX[lane], block.lightY[lane], block.lightZ[lane] };
+								const Vector3 v{ block.viewX[lane], block.viewY[lane], block.viewZ[lane] };
+
+								scalarColors[blockIndex * Float8::Size + lane] = ShadeMaterial<type>(material, hitRecord, l, v);
+							}
+						}
+					});
+
+				const float batchedTime = time([&]()
+					{
+						alignas(32) float r[Float8::Size], g[Float8::Size], b[Float8::Size];
+						for (size_t blockIndex = 0; blockIndex < blocks.size(); ++blockIndex)
+						{
+							const BRDFPairBlock& block = blocks[blockIndex];
+							ShadeMaterial8<type>(material,
+								Vector3x8::Load(block.normalX, block.normalY, block.normalZ),
+								Vector3x8::Load(block.lightX, block.lightY, block.lightZ),
+								Vector3x8::Load(block.viewX, block.viewY, block.viewZ)).Store(r, g, b);
+
+							for (int lane = 0; lane < Float8::Size; ++lane)
+							{
+								batchedColors[blockIndex * Float8::Size + lane] = { r[lane], g[lane], b[lane] };
+							}
+						}
+					});
+
+				//Relative, the specular peaks of smooth materials go far above 1
+				float maxDifference = 0.f;
+				for (size_t i = 0; i < laneCount; ++i)
+				{
+					const ColorRGB& scalar = scalarColors[i];
+					const ColorRGB& batched = batchedColors[i];
+					const float scale = std::max({ 1.f, std::abs(scalar.r), std::abs(scalar.g), std::abs(scalar.b) });
+					maxDifference = std::max({ maxDifference,
+						std::abs(scalar.r - batched.r) / scale, std::abs(scalar.g - batched.g) / scale, std::abs(scalar.b - batched.b) / scale });
+				}
+
+				std::cout << ">> " << name << " = " << scalarTime << " ns scalar, " << batchedTime << " ns batched per pair ("
+					<< scalarTime / batchedTime << "x), max relative difference " << maxDifference << std::endl;
+			};
+
+		std::cout << "**BRDF BENCHMARK** " << laneCount << " (pixel, light) pairs" << std::endl;
+
+		//Float8::Pow against powf on bases over [0, 1] for a range of Phong exponents, relative to powf
+		{
+			constexpr int baseCount = 1 << 16;
+			constexpr float exponents[]{ 1.f, 2.5f, 20.f, 100.f, 1000.f };
+
+			float maxDifference = 0.f;
+			for (const float exponent : exponents)
+			{
+				for (int first = 0; first < baseCount; first += Float8::Size)
+				{
+					alignas(32) float bases[Float8::Size];
+					alignas(32) float powers[Float8::Size];
+					for (int lane = 0; lane < Float8::Size; ++lane)
+					{
+						bases[lane] = static_cast<float>(first + lane) / static_cast<float>(baseCount - 1);
+					}
+
+					Float8::Pow(Float8::Load(bases), Float8::Set(exponent)).Store(powers);
+
+					for (int lane = 0; lane < Float8::Size; ++lane)
+					{
+						//Below the normal range the batched one flushes to 0
+						const float expected = powf(bases[lane], exponent);
+						if (expected >= FLT_MIN)
+							maxDifference = std::max(maxDifference, std::abs(powers[lane] - expected) / expected);
+					}
+				}
+			}
+
+			std::cout << ">> POW = max relative difference " << maxDifference << std::endl;
+		}
+
+		benchmark("COOK TORRENCE METAL", std::integral_constant<MaterialType, MaterialType::CookTorrence>{},
+			Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		benchmark("COOK TORRENCE PLASTIC", std::integral_constant<MaterialType, MaterialType::CookTorrence>{},
+			Material::CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+		benchmark("LAMBERT PHONG", std::integral_constant<MaterialType, MaterialType::LambertPhong>{},
+			Material::LambertPhong({ .49f, 0.57f, 0.57f }, .5f, .5f, 20.f));
+		benchmark("LAMBERT", std::integral_constant<MaterialType, MaterialType::Lambert>{},
+			Material::Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+	}
+
+	//Renders the first frame of the scene shading every light, then with 1, 2, 4, ... light samples per hit, averaging frames
+	//(every frame picks other lights) until the RMSE against the exhaustive frame drops below each target.
+	//Saturated pixels are clamped before averaging, so very low targets may not be reached there. Returns false for an unknown scene
+	bool RunLightSamplingBenchmark(const Options& options)
+	{
+		std::unique_ptr<Scene> pScene = Scene::Create(options.sceneName);
+		if (!pScene)
+		{
+			std::cout << "Unknown scene " << options.sceneName << std::endl;
+			return false;
+		}
+
+		pScene->Initialize();
+
+		Timer timer{};
+		timer.SetFixedTimeStep(options.timeStep);
+		timer.Start();
+
+		pScene->Update(&timer);
+		pScene->UpdateAccelerationStructure();
+
+		//Every frame is rendered in full
+		Renderer renderer{ options.width, options.height, options.threadCount, options.tileSize };
+		renderer.ToggleDirtyRegions();
+		if (options.shadows)
+			renderer.ToggleShadows();
+		if (!options.packets)
+			renderer.TogglePacketTracing();
+		for (uint32_t i = 0; i < options.lightingMode; ++i)
+			renderer.CycleLightingMode();
+		renderer.SetLightCutoff(options.lightCutoff);
+
+		const size_t pixelCount = static_cast<size_t>(options.width) * options.height;
+
+		//In ms
+		const auto render = [&]()
+			{
+				const auto start = std::chrono::steady_clock::now();
+				renderer.Render(pScene.get());
+				return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			};
+
+		const auto addPixels = [&](std::vector<float>& channels)
+			{
+				const uint32_t* pPixels = renderer.GetFrameBuffer().GetPixels();
+				for (size_t i = 0; i < pixelCount; ++i)
+				{
+					channels[i * 3] += static_cast<float>(pPixels[i] >> 16 & 0xFF) / 255.f;
+					channels[i * 3 + 1] += static_cast<float>(pPixels[i] >> 8 & 0xFF) / 255.f;
+					channels[i * 3 + 2] += static_cast<float>(pPixels[i] & 0xFF) / 255.f;
+				}
+			};
+
+		std::vector<float> reference(pixelCount * 3);
+		const float exhaustiveTime = render();
+		addPixels(reference);
+
+		std::cout << "**LIGHT SAMPLING BENCHMARK** " << options.sceneName << " " << options.width << "x" << options.height << std::endl;
+		std::cout << ">> EVERY LIGHT = " << exhaustiveTime << " ms" << std::endl;
+
+		constexpr float errorTargets[] = { .05f, .02f, .01f };
+		constexpr uint32_t maxSampleCount = 32;
+
+		renderer.ToggleLightSampling();
+
+		for (uint32_t sampleCount = 1; sampleCount <= maxSampleCount; sampleCount *= 2)
+		{
+			renderer.SetLightSampleCount(sampleCount);
+
+			std::vector<float> sum(pixelCount * 3);
+			float totalTime = 0.f;
+			float firstError = 0.f;
+			float lastError = 0.f;
+			float timeToError[std::size(errorTargets)]{};
+
+			for (uint32_t frameIndex = 1; frameIndex <= options.lightBenchmarkFrameCount; ++frameIndex)
+			{
+				totalTime += render();
+				addPixels(sum);
+
+				double squaredError = 0.0;
+				for (size_t i = 0; i < sum.size(); ++i)
+				{
+					const double difference = sum[i] / frameIndex - reference[i];
+					squaredError += difference * difference;
+				}
+				lastError = static_cast<float>(std::sqrt(squaredError / sum.size()));
+				if (frameIndex == 1)
+					firstError = lastError;
+
+				for (size_t target = 0; target < std::size(errorTargets); ++target)
+				{
+					if (timeToError[target] == 0.f && lastError <= errorTargets[target])
+						timeToError[target] = totalTime;
+				}
+			}
+
+			std::cout << ">> " << sampleCount << " SAMPLES = " << totalTime / options.lightBenchmarkFrameCount << " ms per frame, RMSE "
+				<< firstError << " after 1 frame, " << lastError << " after " << options.lightBenchmarkFrameCount << ", time to RMSE";
+			for (size_t target = 0; target < std::size(errorTargets); ++target)
+			{
+				std::cout << " " << errorTargets[target] << ": ";
+				if (timeToError[target] > 0.f)
+					std::cout << timeToError[target] << " ms";
+				else
+					std::cout << "-";
+			}
+			std::cout << std::endl;
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char* args[])
+{
+	Options options{};
+	try
+	{
+		if (!ParseOptions(argc, args, options))
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+	catch (const std::exception&)
+	{
+		//stoul/stof on something that is not a number
+		PrintUsage();
+		return 1;
+	}
+
+	if (options.brdfBenchmarkPairCount > 0)
+	{
+		RunBRDFBenchmark(options.brdfBenchmarkPairCount);
+		return 0;
+	}
+
+	if (options.lightBenchmarkFrameCount > 0)
+		return RunLightSamplingBenchmark(options) ? 0 : 1;
+
+	if (!options.workerHost.empty())
+	{
+		RenderWorker worker{ options.threadCount };
+		const bool isConnected = worker.Run(options.workerHost, options.workerPort);
+
+		std::cout << "Rendered " << worker.GetRenderedTileCount() << " tiles" << std::endl;
+		return isConnected ? 0 : 1;
+	}
+
+	//Two instances of the scene, the second one is only used when pipelining
+	std::unique_ptr<Scene> pScene = Scene::Create(options.sceneName);
+	std::unique_ptr<Scene> pNextScene = Scene::Create(options.sceneName);
+	if (!pScene)
+	{
+		std::cout << "Unknown scene " << options.sceneName << std::endl;
+		PrintUsage();
+		return 1;
+	}
+
+	//Renders either here or on the workers of the coordinator
+	std::unique_ptr<Renderer> pRenderer{};
+	std::unique_ptr<RenderCoordinator> pCoordinator{};
+
+	if (options.coordinatorPort != 0)
+	{
+		pCoordinator = std::make_unique<RenderCoordinator>(options.coordinatorPort, options.tileSize);
+		if (!pCoordinator->IsListening())
+		{
+			std::cout << "Could not listen on port " << options.coordinatorPort << std::endl;
+			return 1;
+		}
+
+		std::cout << "Waiting for " << options.workerCount << " workers on port " << options.coordinatorPort << std::endl;
+		pCoordinator->WaitForWorkers(options.workerCount);
+	}
+	else
+	{
+		pRenderer = std::make_unique<Renderer>(options.width, options.height, options.threadCount, options.tileSize);
+
+		if (options.shadows)
+			pRenderer->ToggleShadows();
+		if (!options.packets)
+			pRenderer->TogglePacketTracing();
+		if (options.progressive)
+			pRenderer->ToggleProgressiveRendering();
+		if (options.antiAliasing)
+			pRenderer->ToggleAntiAliasing();
+		if (!options.dirtyRegions)
+			pRenderer->ToggleDirtyRegions();
+		if (options.wavefront)
+			pRenderer->ToggleWavefront();
+		if (!options.batchedShading)
+			pRenderer->ToggleBatchedShading();
+		for (uint32_t i = 0; i < options.temporalMode; ++i)
+			pRenderer->CycleTemporalMode();
+		for (uint32_t i = 0; i < options.lightingMode; ++i)
+			pRenderer->CycleLightingMode();
+		pRenderer->SetLightCutoff(options.lightCutoff);
+		if (options.lightSampleCount > 0)
+		{
+			pRenderer->ToggleLightSampling();
+			pRenderer->SetLightSampleCount(options.lightSampleCount);
+		}
+	}
+
+	pScene->Initialize();
+	if (options.pipeline)
+		pNextScene->Initialize();
+
+	//Frame n shows the scene at n * timeStep, whatever the wall clock says
+	Timer timer{};
+	timer.SetFixedTimeStep(options.timeStep);
+	timer.Start();
+
+	pScene->Update(&timer);
+	pScene->UpdateAccelerationStructure();
+
+	const uint32_t totalFrameCount = options.warmupFrameCount + options.frameCount;
+	const bool writesEveryFrame = options.outputPath.find('#') != std::string::npos;
+
+	std::vector<FrameStats> frameStats{};
+	frameStats.reserve(options.frameCount);
+
+	for (uint32_t frameIndex = 0; frameIndex < totalFrameCount; ++frameIndex)
+	{
+		const auto frameStart = std::chrono::steady_clock::now();
+		const bool isLastFrame = frameIndex + 1 == totalFrameCount;
+
+		if (pCoordinator)
+		{
+			const Camera& camera = pScene->GetCamera();
+
+			FrameDescription description{};
+			description.sceneName = options.sceneName;
+			description.time = timer.GetTotal();
+			description.width = options.width;
+			description.height = options.height;
+			description.cameraOrigin = camera.origin;
+			description.cameraFovAngle = camera.fovAngle;
+			description.cameraTotalPitch = camera.totalPitch;
+			description.cameraTotalYaw = camera.totalYaw;
+			description.shadows = options.shadows;
+			description.lightingMode = options.lightingMode;
+			description.lightCutoff = options.lightCutoff;
+			description.lightSampleCount = options.lightSampleCount;
+
+			if (!pCoordinator->Render(description))
+			{
+				std::cout << "No workers connected, stopping" << std::endl;
+				return 1;
+			}
+
+			if (!isLastFrame)
+			{
+				timer.Update();
+
+				pScene->Update(&timer);
+			}
+		}
+		else if (options.pipeline)
+		{
+			auto renderResult = pRenderer->RenderAsync(pScene.get());
+
+			if (!isLastFrame)
+			{
+				timer.Update();
+
+				pNextScene->GetCamera() = pScene->GetCamera();
+				pNextScene->Update(&timer);
+				pNextScene->UpdateAccelerationStructure();
+			}
+
+			renderResult.wait();
+			pRenderer->SwapFrameBuffers();
+			std::swap(pScene, pNextScene);
+		}
+		else
+		{
+			pRenderer->Render(pScene.get());
+
+			if (!isLastFrame)
+			{
+				timer.Update();
+
+				pScene->Update(&timer);
+				pScene->UpdateAccelerationStructure();
+			}
+		}
+
+		const auto frameEnd = std::chrono::steady_clock::now();
+
+		if (frameIndex >= options.warmupFrameCount)
+		{
+			const float frameTime = std::chrono::duration<float, std::milli>(frameEnd - frameStart).count();
+
+			if (pCoordinator)
+				frameStats.push_back({ frameTime, 1.f, 1.f, 0.f, 1.f, pCoordinator->GetReissuedTileRatio(), 0.f });
+			else
+				frameStats.push_back({ frameTime, pRenderer->GetSamplesPerPixel(), pRenderer->GetLoadImbalance(),
+					pRenderer->GetReusedPixelRatio(), pRenderer->GetDirtyTileRatio(), 0.f, pRenderer->GetTileLightRatio() });
+		}
+
+		if (writesEveryFrame || isLastFrame)
+		{
+			const FrameBuffer& frameBuffer = pCoordinator ? pCoordinator->GetFrameBuffer() : pRenderer->GetFrameBuffer();
+
+			const std::string framePath = GetFramePath(options.outputPath, frameIndex);
+			if (!frameBuffer.SaveToImage(framePath))
+			{
+				std::cout << "Could not write " << framePath << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	//--------- Report ---------
+	const auto average = [&frameStats](float FrameStats::* pMember)
+		{
+			float sum = 0.f;
+			for (const FrameStats& stats : frameStats)
+			{
+				sum += stats.*pMember;
+			}
+			return sum / static_cast<float>(frameStats.size());
+		};
+
+	const auto [pFastest, pSlowest] = std::minmax_element(frameStats.begin(), frameStats.end(),
+		[](const FrameStats& a, const FrameStats& b) { return a.frameTime < b.frameTime; });
+
+	const float averageFrameTime = average(&FrameStats::frameTime);
+
+	std::cout << "**BENCHMARK FINISHED**\n";
+	std::cout << ">> SCENE = " << options.sceneName << " " << options.width << "x" << options.height << std::endl;
+	std::cout << ">> FRAMES = " << frameStats.size() << std::endl;
+	std::cout << ">> AVG = " << averageFrameTime << " ms (" << 1000.f / averageFrameTime << " FPS)" << std::endl;
+	std::cout << ">> LOW = " << pFastest->frameTime << " ms" << std::endl;
+	std::cout << ">> HIGH = " << pSlowest->frameTime << " ms" << std::endl;
+	std::cout << ">> SPP = " << average(&FrameStats::samplesPerPixel) << std::endl;
+	std::cout << ">> LOAD IMBALANCE = " << average(&FrameStats::loadImbalance) << std::endl;
+	std::cout << ">> REUSED = " << average(&FrameStats::reusedPixelRatio) * 100.f << "%" << std::endl;
+	std::cout << ">> DIRTY TILES = " << average(&FrameStats::dirtyTileRatio) * 100.f << "%" << std::endl;
+	if (pCoordinator)
+		std::cout << ">> REISSUED TILES = " << average(&FrameStats::reissuedTileRatio) * 100.f << "%" << std::endl;
+	else
+		std::cout << ">> LIGHTS PER TILE = " << average(&FrameStats::tileLightRatio) * 100.f << "%" << std::endl;
+
+	if (!options.benchmarkPath.empty())
+	{
+		std::ofstream fileStream(options.benchmarkPath);
+		fileStream << "SCENE = " << options.sceneName << std::endl;
+		fileStream << "RESOLUTION = " << options.width << "x" << options.height << std::endl;
+		fileStream << "FRAMES = " << frameStats.size() << std::endl;
+		fileStream << "AVG = " << averageFrameTime << std::endl;
+		fileStream << "LOW = " << pFastest->frameTime << std::endl;
+		fileStream << "HIGH = " << pSlowest->frameTime << std::endl;
+		fileStream << "SPP = " << average(&FrameStats::samplesPerPixel) << std::endl;
+		fileStream << "LOAD IMBALANCE = " << average(&FrameStats::loadImbalance) << std::endl;
+		fileStream << "REUSED = " << average(&FrameStats::reusedPixelRatio) << std::endl;
+		fileStream << "DIRTY TILES = " << average(&FrameStats::dirtyTileRatio) << std::endl;
+		if (pCoordinator)
+			fileStream << "REISSUED TILES = " << average(&FrameStats::reissuedTileRatio) << std::endl;
+		else
+			fileStream << "LIGHTS PER TILE = " << average(&FrameStats::tileLightRatio) << std::endl;
+	}
+
+	return 0;
+}
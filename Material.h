@@ -1,142 +1,212 @@
 #pragma once
+#include <cstdint>
+
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
 
-#include <iostream>
 namespace dae
 {
-#pragma region Material BASE
-	class Material
+#pragma region Material TYPE
+	enum class MaterialType : uint8_t
 	{
-	public:
-		Material() = default;
-		virtual ~Material() = default;
-
-		Material(const Material&) = delete;
-		Material(Material&&) noexcept = delete;
-		Material& operator=(const Material&) = delete;
-		Material& operator=(Material&&) noexcept = delete;
-
-		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
-		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
 	};
 #pragma endregion
 
-#pragma region Material SOLID COLOR
-	//SOLID COLOR
-	//===========
-	class Material_SolidColor final : public Material
+#pragma region Material RECORD
+	/**
+	 * \brief Plain parameter record of a material, the scene keeps them in one flat table indexed by HitRecord::materialIndex.
+	 * Built with the factory functions below, which also precompute everything that does not depend on the hit,
+	 * so ShadeMaterial only does the per-light work. Which fields are used depends on type.
+	 */
+	struct Material
 	{
-	public:
-		Material_SolidColor(const ColorRGB& color) : m_Color(color)
-		{
-		}
+		MaterialType type = MaterialType::SolidColor;
 
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
-		{
-			return m_Color;
-		}
+		ColorRGB color = { colors::White }; //SOLID COLOR: the color, COOK TORRENCE: albedo
+		ColorRGB diffuse = {}; //LAMBERT (PHONG): BRDF::Lambert(kd, diffuse color)
 
-	private:
-		ColorRGB m_Color = { colors::White };
-	};
-#pragma endregion
+		//LAMBERT PHONG
+		float specularReflectance = 0.5f; //ks
+		float phongExponent = 1.f;
 
-#pragma region Material LAMBERT
-	//LAMBERT
-	//=======
-	class Material_Lambert final : public Material
-	{
-	public:
-		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance) {}
+		//COOK TORRENCE
+		ColorRGB f0 = {}; //Base reflectivity
+		bool isMetal = true;
+		float roughness = 0.1f; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
+		float alphaSquared = 0.f; //BRDF::GGX_AlphaSquared(roughness)
+		float geometryK = 0.f; //BRDF::SchlickGGX_DirectK(roughness)
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		//SOLID COLOR
+		//===========
+		static Material SolidColor(const ColorRGB& color)
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			Material material{};
+			material.type = MaterialType::SolidColor;
+			material.color = color;
+			return material;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor = { colors::White };
-		float m_DiffuseReflectance = 1.f; //kd
-	};
-#pragma endregion
-
-#pragma region Material LAMBERT PHONG
-	//LAMBERT-PHONG
-	//=============
-	class Material_LambertPhong final : public Material
-	{
-	public:
-		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(kd), m_SpecularReflectance(ks),
-			m_PhongExponent(phongExponent)
+		//LAMBERT
+		//=======
+		static Material Lambert(const ColorRGB& diffuseColor, float diffuseReflectance)
 		{
+			Material material{};
+			material.type = MaterialType::Lambert;
+			material.diffuse = BRDF::Lambert(diffuseReflectance, diffuseColor);
+			return material;
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		//LAMBERT-PHONG
+		//=============
+		static Material LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent)
 		{
-
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) +
-				BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, v, hitRecord.normal);
-			return {};
+			Material material{};
+			material.type = MaterialType::LambertPhong;
+			material.diffuse = BRDF::Lambert(kd, diffuseColor);
+			material.specularReflectance = ks;
+			material.phongExponent = phongExponent;
+			return material;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor = { colors::White };
-		float m_DiffuseReflectance = 0.5f; //kd
-		float m_SpecularReflectance = 0.5f; //ks
-		float m_PhongExponent = 1.f; //Phong Exponent
+		//COOK TORRENCE
+		//=============
+		static Material CookTorrence(const ColorRGB& albedo, float metalness, float roughness)
+		{
+			Material material{};
+			material.type = MaterialType::CookTorrence;
+			material.color = albedo;
+			material.isMetal = metalness != 0.0f;
+			material.f0 = material.isMetal ? albedo : ColorRGB(0.04f, 0.04f, 0.04f);
+			material.roughness = roughness;
+			material.alphaSquared = BRDF::GGX_AlphaSquared(roughness);
+			material.geometryK = BRDF::SchlickGGX_DirectK(roughness);
+			return material;
+		}
 	};
 #pragma endregion
 
-#pragma region Material COOK TORRENCE
-	//COOK TORRENCE
-	class Material_CookTorrence final : public Material
+#pragma region Material SHADE
+	/**
+	 * \brief Function used to calculate the correct color for the specific material and its parameters,
+	 * for a material type known at compile time (runs of one material, see Renderer::RenderWavefront)
+	 * \param material material record, of type Type
+	 * \param hitRecord current hitrecord
+	 * \param l light direction
+	 * \param v view direction
+	 * \return color
+	 */
+	template<MaterialType Type>
+	inline ColorRGB ShadeMaterial(const Material& material, const HitRecord& hitRecord, const Vector3& l, const Vector3& v)
 	{
-	public:
-		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness) :
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
+		if constexpr (Type == MaterialType::SolidColor)
 		{
+			return material.color;
 		}
-
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		else if constexpr (Type == MaterialType::Lambert)
+		{
+			return material.diffuse;
+		}
+		else if constexpr (Type == MaterialType::LambertPhong)
+		{
+			return material.diffuse +
+				BRDF::Phong(material.specularReflectance, material.phongExponent, l, v, hitRecord.normal);
+		}
+		else
 		{
-		
-			const ColorRGB f0 = (m_Metalness == 0.0f) ? ColorRGB(0.04f, 0.04f, 0.04f) : m_Albedo;
-
 			const Vector3 halfVector = (l + v) / ((l + v).Magnitude());
 
-			ColorRGB F = BRDF::FresnelFunction_Schlick(halfVector, v, f0);
+			ColorRGB F = BRDF::FresnelFunction_Schlick(halfVector, v, material.f0);
+
+			float D = BRDF::NormalDistribution_GGX_AlphaSquared(hitRecord.normal, halfVector, material.alphaSquared);
 
-		
-			float D = BRDF::NormalDistribution_GGX(hitRecord.normal, halfVector, m_Roughness);
-		
-			float G = BRDF::GeometryFunction_Smith(hitRecord.normal, v,l, m_Roughness);
+			float G = BRDF::GeometryFunction_Smith_K(hitRecord.normal, v, l, material.geometryK);
 
 			const ColorRGB specular = (F * D * G) / (4.0f * Vector3::Dot(v, hitRecord.normal) * Vector3::Dot(l, hitRecord.normal));
 
-			const ColorRGB kdRGB = ColorRGB{ 1.0f,1.0f,1.0f } - F;
-			const ColorRGB kd = m_Metalness == 0.0f ? kdRGB : ColorRGB{0, 0, 0};
+			if (material.isMetal)
+				return specular;
 
-			const ColorRGB diffuse{ BRDF::Lambert(kd,m_Albedo) };
+			const ColorRGB kd = ColorRGB{ 1.0f,1.0f,1.0f } - F;
 
-			const ColorRGB finalColor = diffuse + specular;
+			const ColorRGB diffuse{ BRDF::Lambert(kd, material.color) };
 
-			return finalColor;
+			return diffuse + specular;
+		}
+	}
+
+	/**
+	 * \brief Function used to calculate the correct color for the specific material and its parameters
+	 * \param material material record
+	 * \param hitRecord current hitrecord
+	 * \param l light direction
+	 * \param v view direction
+	 * \return color
+	 */
+	inline ColorRGB ShadeMaterial(const Material& material, const HitRecord& hitRecord, const Vector3& l, const Vector3& v)
+	{
+		switch (material.type)
+		{
+		case MaterialType::SolidColor:
+			return ShadeMaterial<MaterialType::SolidColor>(material, hitRecord, l, v);
+		case MaterialType::Lambert:
+			return ShadeMaterial<MaterialType::Lambert>(material, hitRecord, l, v);
+		case MaterialType::LambertPhong:
+			return ShadeMaterial<MaterialType::LambertPhong>(material, hitRecord, l, v);
+		case MaterialType::CookTorrence:
+			return ShadeMaterial<MaterialType::CookTorrence>(material, hitRecord, l, v);
 		}
 
-	private:
-		ColorRGB m_Albedo = { 0.955f, 0.637f, 0.538f }; //Copper
-		float m_Metalness = 1.0f;
-		float m_Roughness = 0.1f; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
-	};
+		return {};
+	}
+
+	/**
+	 * \brief ShadeMaterial<Type> for 8 (pixel, light) pairs at once, see BRDF::Batched
+	 * \param material material record, of type Type
+	 * \param n surface normals
+	 * \param l light directions
+	 * \param v view directions
+	 * \return colors
+	 */
+	template<MaterialType Type>
+	inline ColorRGBx8 ShadeMaterial8(const Material& material, const Vector3x8& n, const Vector3x8& l, const Vector3x8& v)
+	{
+		if constexpr (Type == MaterialType::SolidColor)
+		{
+			return ColorRGBx8::Set(material.color.r, material.color.g, material.color.b);
+		}
+		else if constexpr (Type == MaterialType::Lambert)
+		{
+			return ColorRGBx8::Set(material.diffuse.r, material.diffuse.g, material.diffuse.b);
+		}
+		else if constexpr (Type == MaterialType::LambertPhong)
+		{
+			const Float8 specular = BRDF::Batched::Phong(material.specularReflectance, material.phongExponent, l, v, n);
+			return { Float8::Set(material.diffuse.r) + specular, Float8::Set(material.diffuse.g) + specular, Float8::Set(material.diffuse.b) + specular };
+		}
+		else
+		{
+			const Vector3x8 halfVector = (l + v) / (l + v).Magnitude();
+
+			const ColorRGBx8 F = BRDF::Batched::FresnelFunction_Schlick(halfVector, v, material.f0);
+			const Float8 D = BRDF::Batched::NormalDistribution_GGX_AlphaSquared(n, halfVector, material.alphaSquared);
+			const Float8 G = BRDF::Batched::GeometryFunction_Smith_K(n, v, l, material.geometryK);
+
+			//F * D, the scalar ShadeMaterial takes kd from F after F * D * G scaled it by D
+			const ColorRGBx8 FD = F * D;
+			const ColorRGBx8 specular = (FD * G) / (Float8::Set(4.0f) * Vector3x8::Dot(v, n) * Vector3x8::Dot(l, n));
+
+			if (material.isMetal)
+				return specular;
+
+			const ColorRGBx8 kd = ColorRGBx8::Set(1.0f, 1.0f, 1.0f) - FD;
+
+			return BRDF::Batched::Lambert(kd, material.color) + specular;
+		}
+	}
 #pragma endregion
 }
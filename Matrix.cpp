@@ -83,6 +83,36 @@ namespace dae {
 		return out;
 	}
 
+	Matrix Matrix::Inverse(const Matrix& m)
+	{
+		//Affine inverse: invert the 3x3 part through its cofactors, then undo the translation
+		const Vector3 a = m[0];
+		const Vector3 b = m[1];
+		const Vector3 c = m[2];
+
+		const Vector3 r0 = Vector3::Cross(b, c);
+		const Vector3 r1 = Vector3::Cross(c, a);
+		const Vector3 r2 = Vector3::Cross(a, b);
+
+		const float determinant = Vector3::Dot(a, r0);
+		assert(determinant != 0.f && "Matrix is not invertible");
+
+		const float invDeterminant = 1.f / determinant;
+
+		Matrix result
+		{
+			Vector3{ r0.x, r1.x, r2.x } * invDeterminant,
+			Vector3{ r0.y, r1.y, r2.y } * invDeterminant,
+			Vector3{ r0.z, r1.z, r2.z } * invDeterminant,
+			Vector3{}
+		};
+
+		const Vector3 t = m.GetTranslation();
+		result[3] = { -result.TransformVector(t), 1.f };
+
+		return result;
+	}
+
 	Vector3 Matrix::GetAxisX() const
 	{
 		return data[0];
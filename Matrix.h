@@ -41,6 +41,7 @@ namespace dae {
 		static Matrix CreateScale(float sx, float sy, float sz);
 		static Matrix CreateScale(const Vector3& s);
 		static Matrix Transpose(const Matrix& m);
+		static Matrix Inverse(const Matrix& m);
 
 		Vector4& operator[](int index);
 		Vector4 operator[](int index) const;
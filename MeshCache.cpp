@@ -0,0 +1,478 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Utils.h"
+
+namespace dae
+{
+#pragma region MappedFile
+	std::shared_ptr<const MappedFile> MappedFile::Open(const std::string& filename)
+	{
+		std::shared_ptr<MappedFile> pFile{ new MappedFile() };
+
+#if defined(_WIN32)
+		//Sharing writes and deletes lets a cache be replaced or have its header updated (MeshCache) while it is still mapped
+		const HANDLE fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		pFile->m_pFileHandle = fileHandle;
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(fileHandle, &size))
+			return nullptr;
+
+		pFile->m_Size = static_cast<size_t>(size.QuadPart);
+		if (pFile->m_Size == 0)
+			return pFile;
+
+		const HANDLE mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mappingHandle)
+			return nullptr;
+
+		pFile->m_pMappingHandle = mappingHandle;
+		pFile->m_pData = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+		const int fileDescriptor = open(filename.c_str(), O_RDONLY);
+		if (fileDescriptor < 0)
+			return nullptr;
+
+		struct stat fileStats{};
+		if (fstat(fileDescriptor, &fileStats) != 0)
+		{
+			close(fileDescriptor);
+			return nullptr;
+		}
+
+		pFile->m_Size = static_cast<size_t>(fileStats.st_size);
+		if (pFile->m_Size == 0)
+		{
+			close(fileDescriptor);
+			return pFile;
+		}
+
+		void* pData = mmap(nullptr, pFile->m_Size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		close(fileDescriptor); //The mapping keeps its own reference to the file
+
+		pFile->m_pData = pData == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(pData);
+#endif
+
+		if (!pFile->m_pData)
+			return nullptr;
+
+		return pFile;
+	}
+
+	MappedFile::~MappedFile()
+	{
+#if defined(_WIN32)
+		if (m_pData)
+			UnmapViewOfFile(m_pData);
+		if (m_pMappingHandle)
+			CloseHandle(m_pMappingHandle);
+		if (m_pFileHandle)
+			CloseHandle(m_pFileHandle);
+#else
+		if (m_pData)
+			munmap(const_cast<uint8_t*>(m_pData), m_Size);
+#endif
+	}
+#pragma endregion
+
+#pragma region MeshCache
+	namespace MeshCache
+	{
+		namespace
+		{
+			enum Section
+			{
+				Positions,
+				Normals,
+				Indices,
+				BVHNodes,
+				PrimIndices,
+				TriangleBlocks,
+				SectionCount
+			};
+
+			struct SectionRange
+			{
+				uint64_t offset;
+				uint64_t count;
+			};
+
+			struct Header
+			{
+				char magic[4];
+				uint32_t version;
+				uint64_t sourceHash;
+				uint64_t sourceSize;
+				int64_t sourceModifiedTime;
+
+				//Layout checks, a cache written by a build with different structs is rejected
+				uint32_t vector3Size;
+				uint32_t bvhNodeSize;
+				uint32_t triangleBlockSize;
+				uint32_t padding;
+
+				float minAABB[3];
+				float maxAABB[3];
+
+				SectionRange sections[SectionCount];
+			};
+
+			constexpr char Magic[4] = { 'R', 'T', 'M', 'C' };
+			constexpr uint64_t SectionAlignment = 64;
+
+			std::string GetCacheFilename(const std::string& sourceFilename)
+			{
+				return sourceFilename + ".rtcache";
+			}
+
+			template<typename T>
+			std::span<const T> GetSection(const MappedFile& file, const Header& header, Section section)
+			{
+				const SectionRange& range = header.sections[section];
+				return { reinterpret_cast<const T*>(file.GetData() + range.offset), static_cast<size_t>(range.count) };
+			}
+
+			template<typename T>
+			bool IsSectionValid(const MappedFile& file, const Header& header, Section section)
+			{
+				const SectionRange& range = header.sections[section];
+				return range.offset % alignof(T) == 0 &&
+					range.offset <= file.GetSize() &&
+					range.count <= (file.GetSize() - range.offset) / sizeof(T);
+			}
+
+			//The sections are used without any bounds checks during traversal, so a corrupt cache must never reach the mesh
+			bool IsContentValid(const MeshCacheView& view)
+			{
+				const size_t positionCount = view.positions.size();
+				const size_t triangleCount = view.indices.size() / 3;
+				const size_t nodeCount = view.bvhNodes.size();
+				const size_t blockCount = view.triangleBlocks.size();
+
+				if (view.indices.size() % 3 != 0 ||
+					view.normals.size() != triangleCount ||
+					view.primIndices.size() != triangleCount)
+				{
+					return false;
+				}
+
+				for (const int index : view.indices)
+				{
+					if (index < 0 || static_cast<size_t>(index) >= positionCount)
+						return false;
+				}
+
+				for (const uint32_t primIndex : view.primIndices)
+				{
+					if (primIndex >= triangleCount)
+						return false;
+				}
+
+				if (nodeCount == 0)
+					return blockCount == 0;
+
+				//Children always lie after their parent, which rules out cycles and lets the depth be found in one pass
+				std::vector<uint32_t> depths(nodeCount, 0);
+				size_t leafCount = 0;
+
+				for (size_t nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex)
+				{
+					const BVH4Node& node = view.bvhNodes[nodeIndex];
+
+					for (int slot = 0; slot < 4; ++slot)
+					{
+						const uint32_t child = node.child[slot];
+						const uint32_t count = node.count[slot];
+
+						if (count > 0)
+						{
+							if (child >= blockCount || count > TriangleBlock::Size)
+								return false;
+
+							++leafCount;
+							continue;
+						}
+
+						if (child == BVH4Node::EmptySlot)
+						{
+							//Empty slots are only skipped because their box can never be hit
+							if (!(node.minX[slot] > node.maxX[slot] && node.minY[slot] > node.maxY[slot] && node.minZ[slot] > node.maxZ[slot]))
+								return false;
+							continue;
+						}
+
+						if (child <= nodeIndex || child >= nodeCount)
+							return false;
+
+						depths[child] = std::max(depths[child], depths[nodeIndex] + 1);
+						if (depths[child] > static_cast<uint32_t>(BVH::MaxDepth))
+							return false;
+					}
+				}
+
+				return leafCount == blockCount;
+			}
+
+			template<typename T>
+			void WriteSection(std::ofstream& stream, Header& header, Section section, std::span<const T> data)
+			{
+				//Pad so every section can be used in place from the page-aligned mapping
+				const uint64_t position = static_cast<uint64_t>(stream.tellp());
+				const uint64_t offset = (position + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+
+				const char padding[SectionAlignment] = {};
+				stream.write(padding, static_cast<std::streamsize>(offset - position));
+				stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size_bytes()));
+
+				header.sections[section] = { offset, data.size() };
+			}
+		}
+
+		SourceStamp GetSourceStamp(const std::string& filename)
+		{
+			std::error_code error{};
+
+			const uintmax_t size = std::filesystem::file_size(filename, error);
+			if (error)
+				return {};
+
+			const std::filesystem::file_time_type modifiedTime = std::filesystem::last_write_time(filename, error);
+			if (error)
+				return {};
+
+			return { static_cast<uint64_t>(size), static_cast<int64_t>(modifiedTime.time_since_epoch().count()), 0 };
+		}
+
+		uint64_t HashFile(const std::string& filename)
+		{
+			const std::shared_ptr<const MappedFile> pFile = MappedFile::Open(filename);
+			if (!pFile)
+				return 0;
+
+			//FNV-1a over 8 byte words, only used to detect a changed source file
+			constexpr uint64_t prime = 0x100000001b3ull;
+			uint64_t hash = 0xcbf29ce484222325ull;
+
+			const uint8_t* pData = pFile->GetData();
+			const size_t size = pFile->GetSize();
+
+			size_t i = 0;
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+			{
+				uint64_t word;
+				std::memcpy(&word, pData + i, sizeof(word));
+				hash = (hash ^ word) * prime;
+			}
+			for (; i < size; ++i)
+			{
+				hash = (hash ^ pData[i]) * prime;
+			}
+
+			return (hash ^ size) * prime;
+		}
+
+		bool Load(const std::string& sourceFilename, SourceStamp& sourceStamp, TriangleMesh& mesh)
+		{
+			const std::shared_ptr<const MappedFile> pFile = MappedFile::Open(GetCacheFilename(sourceFilename));
+			if (!pFile || pFile->GetSize() < sizeof(Header))
+				return false;
+
+			Header header{};
+			std::memcpy(&header, pFile->GetData(), sizeof(Header));
+
+			if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+				header.version != Version ||
+				header.sourceSize != sourceStamp.size ||
+				header.vector3Size != sizeof(Vector3) ||
+				header.bvhNodeSize != sizeof(BVH4Node) ||
+				header.triangleBlockSize != sizeof(TriangleBlock))
+			{
+				return false;
+			}
+
+			if (header.sourceModifiedTime != sourceStamp.modifiedTime)
+			{
+				if (sourceStamp.hash == 0)
+					sourceStamp.hash = HashFile(sourceFilename);
+
+				if (header.sourceHash != sourceStamp.hash)
+					return false;
+			}
+
+			if (!IsSectionValid<Vector3>(*pFile, header, Positions) ||
+				!IsSectionValid<Vector3>(*pFile, header, Normals) ||
+				!IsSectionValid<int>(*pFile, header, Indices) ||
+				!IsSectionValid<BVH4Node>(*pFile, header, BVHNodes) ||
+				!IsSectionValid<uint32_t>(*pFile, header, PrimIndices) ||
+				!IsSectionValid<TriangleBlock>(*pFile, header, TriangleBlocks))
+			{
+				return false;
+			}
+
+			MeshCacheView view{};
+			view.pFile = pFile;
+			view.positions = GetSection<Vector3>(*pFile, header, Positions);
+			view.normals = GetSection<Vector3>(*pFile, header, Normals);
+			view.indices = GetSection<int>(*pFile, header, Indices);
+			view.bvhNodes = GetSection<BVH4Node>(*pFile, header, BVHNodes);
+			view.primIndices = GetSection<uint32_t>(*pFile, header, PrimIndices);
+			view.triangleBlocks = GetSection<TriangleBlock>(*pFile, header, TriangleBlocks);
+			view.minAABB = { header.minAABB[0], header.minAABB[1], header.minAABB[2] };
+			view.maxAABB = { header.maxAABB[0], header.maxAABB[1], header.maxAABB[2] };
+
+			if (!IsContentValid(view))
+			{
+				std::cout << "Ignoring the corrupt mesh cache for " << sourceFilename << std::endl;
+				return false;
+			}
+
+			//The mesh reads everything through the view from now on
+			mesh.positions.clear();
+			mesh.normals.clear();
+			mesh.indices.clear();
+			mesh.bvh = {};
+			mesh.bvh4 = {};
+			mesh.triangleBlocks.clear();
+			mesh.pCache = std::make_shared<MeshCacheView>(std::move(view));
+
+			return true;
+		}
+
+		bool Save(const std::string& sourceFilename, const SourceStamp& sourceStamp, const TriangleMesh& mesh)
+		{
+			const std::string cacheFilename = GetCacheFilename(sourceFilename);
+			const std::string tempFilename = cacheFilename + ".tmp";
+
+			{
+				std::ofstream stream(tempFilename, std::ios::binary | std::ios::trunc);
+				if (!stream)
+					return false;
+
+				Header header{};
+				std::memcpy(header.magic, Magic, sizeof(Magic));
+				header.version = Version;
+				header.sourceHash = sourceStamp.hash;
+				header.sourceSize = sourceStamp.size;
+				header.sourceModifiedTime = sourceStamp.modifiedTime;
+				header.vector3Size = sizeof(Vector3);
+				header.bvhNodeSize = sizeof(BVH4Node);
+				header.triangleBlockSize = sizeof(TriangleBlock);
+
+				header.minAABB[0] = mesh.minAABB.x;
+				header.minAABB[1] = mesh.minAABB.y;
+				header.minAABB[2] = mesh.minAABB.z;
+				header.maxAABB[0] = mesh.maxAABB.x;
+				header.maxAABB[1] = mesh.maxAABB.y;
+				header.maxAABB[2] = mesh.maxAABB.z;
+
+				//Header is rewritten once the section offsets are known
+				stream.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+				WriteSection(stream, header, Positions, mesh.GetPositions());
+				WriteSection(stream, header, Normals, mesh.GetNormals());
+				WriteSection(stream, header, Indices, mesh.GetIndices());
+				WriteSection(stream, header, BVHNodes, mesh.GetBVHNodes());
+				WriteSection(stream, header, PrimIndices, mesh.GetPrimIndices());
+				WriteSection(stream, header, TriangleBlocks, mesh.GetTriangleBlocks());
+
+				stream.seekp(0);
+				stream.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+				if (!stream)
+					return false;
+			}
+
+			//Only replace the old cache with a complete file
+			std::error_code error{};
+			std::filesystem::rename(tempFilename, cacheFilename, error);
+			return !error;
+		}
+
+		bool UpdateSourceStamp(const std::string& sourceFilename, const SourceStamp& sourceStamp)
+		{
+			std::fstream stream(GetCacheFilename(sourceFilename), std::ios::binary | std::ios::in | std::ios::out);
+			if (!stream)
+				return false;
+
+			Header header{};
+			stream.read(reinterpret_cast<char*>(&header), sizeof(Header));
+
+			if (!stream ||
+				std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+				header.version != Version ||
+				header.sourceHash != sourceStamp.hash ||
+				header.sourceSize != sourceStamp.size)
+			{
+				return false;
+			}
+
+			header.sourceModifiedTime = sourceStamp.modifiedTime;
+
+			stream.seekp(0);
+			stream.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			return static_cast<bool>(stream.flush());
+		}
+
+		bool LoadOBJ(const std::string& filename, TriangleMesh& mesh)
+		{
+			const auto startTime = std::chrono::high_resolution_clock::now();
+
+			SourceStamp sourceStamp = GetSourceStamp(filename);
+
+			if (Load(filename, sourceStamp, mesh))
+			{
+				const std::chrono::duration<float, std::milli> loadTime = std::chrono::high_resolution_clock::now() - startTime;
+				std::cout << "Mapped " << filename << " from cache (" << mesh.GetIndices().size() / 3 << " triangles) in " << loadTime.count() << " ms" << std::endl;
+
+				//The source was touched but not changed, store its new time so the next launch skips the hash.
+				//Only the header is rewritten, in place, the cache stays mapped by the mesh
+				if (sourceStamp.hash != 0 && !UpdateSourceStamp(filename, sourceStamp))
+					std::cout << "Could not update the mesh cache for " << filename << std::endl;
+
+				return true;
+			}
+
+			if (!Utils::ParseOBJ(filename, mesh.positions, mesh.normals, mesh.indices))
+				return false;
+
+			const auto buildStartTime = std::chrono::high_resolution_clock::now();
+
+			mesh.UpdateAABB();
+			mesh.UpdateBVH();
+
+			const std::chrono::duration<float, std::milli> buildTime = std::chrono::high_resolution_clock::now() - buildStartTime;
+			std::cout << "BVH built for " << mesh.indices.size() / 3 << " triangles (" << mesh.bvh.nodes.size() << " nodes) in " << buildTime.count() << " ms" << std::endl;
+
+			if (sourceStamp.hash == 0)
+				sourceStamp.hash = HashFile(filename);
+
+			if (!Save(filename, sourceStamp, mesh))
+				std::cout << "Could not write the mesh cache for " << filename << std::endl;
+
+			return true;
+		}
+	}
+#pragma endregion
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Read-only memory mapping of a whole file, unmapped when the last reference goes away
+	class MappedFile final
+	{
+	public:
+		static std::shared_ptr<const MappedFile> Open(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		const uint8_t* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		MappedFile() = default;
+
+		const uint8_t* m_pData = nullptr;
+		size_t m_Size = 0;
+
+		void* m_pFileHandle = nullptr; //Windows only
+		void* m_pMappingHandle = nullptr; //Windows only
+	};
+
+	/**
+	 * \brief Versioned binary cache of a parsed OBJ and its BVH, stored next to the source as <filename>.rtcache.
+	 * A cache is only used when the size and modification time of the source match the ones it was written for,
+	 * the source is only hashed when just the time differs (e.g. after a checkout) to tell a touched file from a changed one.
+	 * Loading maps the file and points the mesh straight into the mapping, nothing is copied.
+	 */
+	namespace MeshCache
+	{
+		constexpr uint32_t Version = 4;
+
+		struct SourceStamp
+		{
+			uint64_t size;
+			int64_t modifiedTime;
+			uint64_t hash; //0 until the source was hashed
+		};
+
+		SourceStamp GetSourceStamp(const std::string& filename);
+		uint64_t HashFile(const std::string& filename);
+
+		//Fills in sourceStamp.hash when the source had to be hashed
+		bool Load(const std::string& sourceFilename, SourceStamp& sourceStamp, TriangleMesh& mesh);
+		bool Save(const std::string& sourceFilename, const SourceStamp& sourceStamp, const TriangleMesh& mesh);
+		//Rewrites only the source modification time in the header of a cache written for the same source, works while it is mapped
+		bool UpdateSourceStamp(const std::string& sourceFilename, const SourceStamp& sourceStamp);
+
+		//Loads the mesh from its cache when that is valid, otherwise parses the OBJ, builds the BVH and writes a new cache
+		bool LoadOBJ(const std::string& filename, TriangleMesh& mesh);
+	}
+}
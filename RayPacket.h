@@ -0,0 +1,441 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+#include "Utils.h"
+
+namespace dae
+{
+#pragma region RayPacket
+	/**
+	 * \brief Up to 8x8 primary rays sharing one origin, stored as SoA so a box can be slab tested against 4 rays at a time.
+	 * The frustum is spanned by the corner directions of the tile, every ray of the packet lies inside it.
+	 */
+	struct RayPacket
+	{
+		static constexpr uint32_t TileSize = 8;
+		static constexpr uint32_t MaxRayCount = TileSize * TileSize;
+
+		Vector3 origin = {};
+
+		alignas(16) float directionX[MaxRayCount];
+		alignas(16) float directionY[MaxRayCount];
+		alignas(16) float directionZ[MaxRayCount];
+
+		alignas(16) float invDirectionX[MaxRayCount];
+		alignas(16) float invDirectionY[MaxRayCount];
+		alignas(16) float invDirectionZ[MaxRayCount];
+
+		//Padded to a multiple of 4 with copies of the last ray, see Finalize
+		uint32_t rayCount = 0;
+
+		Vector3 cornerDirections[4] = {}; //In winding order around the tile
+		Vector3 frustumNormals[4] = {}; //Side planes through origin, pointing inwards
+		float maxDirectionLength = 0.f; //Directions are not normalized, this turns distances into a bound on t
+
+		void AddRay(const Vector3& direction)
+		{
+			assert(rayCount < MaxRayCount);
+
+			directionX[rayCount] = direction.x;
+			directionY[rayCount] = direction.y;
+			directionZ[rayCount] = direction.z;
+			++rayCount;
+		}
+
+		Ray GetRay(uint32_t rayIndex) const
+		{
+			return { origin, { directionX[rayIndex], directionY[rayIndex], directionZ[rayIndex] } };
+		}
+
+		//Call once all rays are added
+		void Finalize(const Vector3 corners[4])
+		{
+			while (rayCount % 4 != 0)
+			{
+				AddRay({ directionX[rayCount - 1], directionY[rayCount - 1], directionZ[rayCount - 1] });
+			}
+
+			maxDirectionLength = 0.f;
+			for (uint32_t i = 0; i < rayCount; ++i)
+			{
+				invDirectionX[i] = 1.f / directionX[i];
+				invDirectionY[i] = 1.f / directionY[i];
+				invDirectionZ[i] = 1.f / directionZ[i];
+
+				const float sqrLength = directionX[i] * directionX[i] + directionY[i] * directionY[i] + directionZ[i] * directionZ[i];
+				maxDirectionLength = std::max(maxDirectionLength, sqrtf(sqrLength));
+			}
+
+			const Vector3 center = corners[0] + corners[1] + corners[2] + corners[3];
+
+			for (int i = 0; i < 4; ++i)
+			{
+				cornerDirections[i] = corners[i];
+
+				//Winding depends on the handedness of the transform, so orient by the center direction
+				Vector3 normal = Vector3::Cross(corners[i], corners[(i + 1) % 4]);
+				if (Vector3::Dot(normal, center) < 0.f)
+					normal = -normal;
+
+				frustumNormals[i] = normal;
+			}
+		}
+
+		//Same rays in another space (e.g. the object space of a mesh), the directions are not renormalized so t is unchanged
+		RayPacket Transformed(const Matrix& transform) const
+		{
+			RayPacket packet{};
+			packet.origin = transform.TransformPoint(origin);
+
+			for (uint32_t i = 0; i < rayCount; ++i)
+			{
+				packet.AddRay(transform.TransformVector(directionX[i], directionY[i], directionZ[i]));
+			}
+
+			const Vector3 corners[4] =
+			{
+				transform.TransformVector(cornerDirections[0]),
+				transform.TransformVector(cornerDirections[1]),
+				transform.TransformVector(cornerDirections[2]),
+				transform.TransformVector(cornerDirections[3])
+			};
+			packet.Finalize(corners);
+
+			return packet;
+		}
+	};
+#pragma endregion
+
+	namespace GeometryUtils
+	{
+#pragma region RayPacket Tests
+		//Conservative: false means no ray of the packet can hit the box closer than maxDistance
+		inline bool FrustumTest_AABB(const RayPacket& packet, const Vector3& aabbMin, const Vector3& aabbMax, float maxDistance)
+		{
+			for (const Vector3& normal : packet.frustumNormals)
+			{
+				//Corner furthest along the plane normal
+				const Vector3 corner
+				{
+					normal.x >= 0.f ? aabbMax.x : aabbMin.x,
+					normal.y >= 0.f ? aabbMax.y : aabbMin.y,
+					normal.z >= 0.f ? aabbMax.z : aabbMin.z
+				};
+
+				if (Vector3::Dot(normal, corner - packet.origin) < 0.f)
+					return false;
+			}
+
+			const float dx = std::max({ aabbMin.x - packet.origin.x, 0.f, packet.origin.x - aabbMax.x });
+			const float dy = std::max({ aabbMin.y - packet.origin.y, 0.f, packet.origin.y - aabbMax.y });
+			const float dz = std::max({ aabbMin.z - packet.origin.z, 0.f, packet.origin.z - aabbMax.z });
+
+			const float maxReach = maxDistance * packet.maxDirectionLength;
+			return dx * dx + dy * dy + dz * dz <= maxReach * maxReach;
+		}
+
+		//Slab test of rays [first, first + 4) against one box, returns a bit per ray that enters it before its maxDistance
+		inline uint32_t SlabTestPacket_AABB(const RayPacket& packet, uint32_t first, const Vector3& aabbMin, const Vector3& aabbMax, const float* maxDistances)
+		{
+			const __m128 originX = _mm_set1_ps(packet.origin.x);
+			const __m128 originY = _mm_set1_ps(packet.origin.y);
+			const __m128 originZ = _mm_set1_ps(packet.origin.z);
+
+			const __m128 invDirectionX = _mm_load_ps(packet.invDirectionX + first);
+			const __m128 invDirectionY = _mm_load_ps(packet.invDirectionY + first);
+			const __m128 invDirectionZ = _mm_load_ps(packet.invDirectionZ + first);
+
+			const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabbMin.x), originX), invDirectionX);
+			const __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabbMax.x), originX), invDirectionX);
+			const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabbMin.y), originY), invDirectionY);
+			const __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabbMax.y), originY), invDirectionY);
+			const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabbMin.z), originZ), invDirectionZ);
+			const __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabbMax.z), originZ), invDirectionZ);
+
+			const __m128 tmin = _mm_max_ps(_mm_min_ps(tx1, tx2), _mm_max_ps(_mm_min_ps(ty1, ty2), _mm_min_ps(tz1, tz2)));
+			const __m128 tmax = _mm_min_ps(_mm_max_ps(tx1, tx2), _mm_min_ps(_mm_max_ps(ty1, ty2), _mm_max_ps(tz1, tz2)));
+
+			const __m128 hit = _mm_and_ps(
+				_mm_and_ps(_mm_cmpge_ps(tmax, tmin), _mm_cmpgt_ps(tmax, _mm_setzero_ps())),
+				_mm_cmplt_ps(tmin, _mm_load_ps(maxDistances + first)));
+
+			return static_cast<uint32_t>(_mm_movemask_ps(hit));
+		}
+
+		inline float GetMaxDistance(const float* maxDistances, uint32_t rayCount)
+		{
+			if (rayCount == 0)
+				return 0.f;
+
+			return *std::max_element(maxDistances, maxDistances + rayCount);
+		}
+
+		//Frustum traversal of a binary BVH, nearest boxes first. maxDistance is re-read after every leaf
+		template<typename LeafFunction>
+		inline void TraverseBVH(const BVH& bvh, const RayPacket& packet, const float& maxDistance, LeafFunction&& leafFunction)
+		{
+			if (bvh.IsEmpty())
+				return;
+
+			constexpr int maxStackSize = BVH::TraversalStackSize;
+			uint32_t stack[maxStackSize];
+			int stackSize = 0;
+
+			stack[stackSize++] = 0;
+
+			while (stackSize > 0)
+			{
+				const BVHNode& node = bvh.nodes[stack[--stackSize]];
+
+				if (!FrustumTest_AABB(packet, node.aabbMin, node.aabbMax, maxDistance))
+					continue;
+
+				if (node.IsLeaf())
+				{
+					for (uint32_t i = 0; i < node.primCount; ++i)
+					{
+						if (leafFunction(bvh.primIndices[node.leftFirst + i]))
+							return;
+					}
+					continue;
+				}
+
+				//Push the child further from the packet origin first
+				const Vector3 leftOffset = AABB{ bvh.nodes[node.leftFirst].aabbMin, bvh.nodes[node.leftFirst].aabbMax }.Center() - packet.origin;
+				const Vector3 rightOffset = AABB{ bvh.nodes[node.leftFirst + 1].aabbMin, bvh.nodes[node.leftFirst + 1].aabbMax }.Center() - packet.origin;
+				const bool isLeftNearer = leftOffset.SqrMagnitude() < rightOffset.SqrMagnitude();
+
+				if (stackSize + 2 > maxStackSize)
+					ReportTraversalStackOverflow();
+				stack[stackSize++] = isLeftNearer ? node.leftFirst + 1 : node.leftFirst;
+				stack[stackSize++] = isLeftNearer ? node.leftFirst : node.leftFirst + 1;
+			}
+		}
+
+		//Frustum traversal of a wide BVH, nearest boxes first. leafFunction(node, slot) gets the leaf with its box,
+		//returning true stops the traversal. maxDistance is re-read after every leaf
+		template<typename LeafFunction>
+		inline void TraverseBVH4(std::span<const BVH4Node> nodes, const RayPacket& packet, const float& maxDistance, LeafFunction&& leafFunction)
+		{
+			if (nodes.empty())
+				return;
+
+			struct StackEntry
+			{
+				uint32_t node;
+				uint32_t slot;
+				float distance;
+			};
+
+			constexpr int maxStackSize = BVH4::TraversalStackSize;
+			StackEntry stack[maxStackSize];
+			int stackSize = 0;
+
+			const __m128 originX = _mm_set1_ps(packet.origin.x);
+			const __m128 originY = _mm_set1_ps(packet.origin.y);
+			const __m128 originZ = _mm_set1_ps(packet.origin.z);
+			const __m128 zero = _mm_setzero_ps();
+
+			uint32_t nodeIndex = 0;
+
+			while (true)
+			{
+				const BVH4Node& node = nodes[nodeIndex];
+
+				const __m128 minX = _mm_load_ps(node.minX);
+				const __m128 minY = _mm_load_ps(node.minY);
+				const __m128 minZ = _mm_load_ps(node.minZ);
+				const __m128 maxX = _mm_load_ps(node.maxX);
+				const __m128 maxY = _mm_load_ps(node.maxY);
+				const __m128 maxZ = _mm_load_ps(node.maxZ);
+
+				//Empty slots have inverted boxes, they fail at least one of the side planes
+				__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (const Vector3& normal : packet.frustumNormals)
+				{
+					const __m128 cornerX = _mm_sub_ps(normal.x >= 0.f ? maxX : minX, originX);
+					const __m128 cornerY = _mm_sub_ps(normal.y >= 0.f ? maxY : minY, originY);
+					const __m128 cornerZ = _mm_sub_ps(normal.z >= 0.f ? maxZ : minZ, originZ);
+
+					const __m128 planeDistance = _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(cornerX, _mm_set1_ps(normal.x)),
+						_mm_mul_ps(cornerY, _mm_set1_ps(normal.y))),
+						_mm_mul_ps(cornerZ, _mm_set1_ps(normal.z)));
+
+					visible = _mm_and_ps(visible, _mm_cmpge_ps(planeDistance, zero));
+				}
+
+				//Distance from the origin to each box, bounds how close a hit inside it can be
+				const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, originX), _mm_sub_ps(originX, maxX)), zero);
+				const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, originY), _mm_sub_ps(originY, maxY)), zero);
+				const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, originZ), _mm_sub_ps(originZ, maxZ)), zero);
+				const __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+
+				const float maxReach = maxDistance * packet.maxDirectionLength;
+				visible = _mm_and_ps(visible, _mm_cmple_ps(distance, _mm_set1_ps(maxReach)));
+
+				int visibleMask = _mm_movemask_ps(visible);
+
+				alignas(16) float distances[4];
+				_mm_store_ps(distances, distance);
+
+				//Insertion sort far to near, so the nearest ends up on top of the stack
+				StackEntry visibleChildren[4];
+				int visibleCount = 0;
+
+				while (visibleMask)
+				{
+					const int slot = std::countr_zero(static_cast<unsigned>(visibleMask));
+					visibleMask &= visibleMask - 1;
+
+					const StackEntry child{ nodeIndex, static_cast<uint32_t>(slot), distances[slot] };
+
+					int i = visibleCount++;
+					while (i > 0 && visibleChildren[i - 1].distance < child.distance)
+					{
+						visibleChildren[i] = visibleChildren[i - 1];
+						--i;
+					}
+					visibleChildren[i] = child;
+				}
+
+				if (stackSize + visibleCount > maxStackSize)
+					ReportTraversalStackOverflow();
+				for (int i = 0; i < visibleCount; ++i)
+				{
+					stack[stackSize++] = visibleChildren[i];
+				}
+
+				//Pop until an interior child is found, leaves are handled on the way
+				nodeIndex = UINT32_MAX;
+				while (stackSize > 0 && nodeIndex == UINT32_MAX)
+				{
+					const StackEntry entry = stack[--stackSize];
+
+					if (entry.distance > maxDistance * packet.maxDirectionLength)
+						continue;
+
+					const BVH4Node& parent = nodes[entry.node];
+
+					if (parent.count[entry.slot] == 0)
+					{
+						nodeIndex = parent.child[entry.slot];
+						continue;
+					}
+
+					if (leafFunction(parent, entry.slot))
+						return;
+				}
+
+				if (nodeIndex == UINT32_MAX)
+					return;
+			}
+		}
+
+		inline Vector3 GetLeafMin(const BVH4Node& node, uint32_t slot) { return { node.minX[slot], node.minY[slot], node.minZ[slot] }; }
+		inline Vector3 GetLeafMax(const BVH4Node& node, uint32_t slot) { return { node.maxX[slot], node.maxY[slot], node.maxZ[slot] }; }
+
+		/**
+		 * \brief Closest hit of every ray in the packet with the mesh, only hits closer than hitRecords[i].t are written.
+		 * Traces the rays one by one when the packet diverges (it visits more leaves than it has rays).
+		 */
+		inline void HitTest_TriangleMesh(const TriangleMesh& mesh, const RayPacket& packet, HitRecord* hitRecords)
+		{
+			if (!FrustumTest_AABB(packet, mesh.transformedMinAABB, mesh.transformedMaxAABB, FLT_MAX))
+				return;
+
+			const RayPacket objectPacket = packet.Transformed(mesh.inverseTransform);
+			const std::span<const TriangleBlock> blocks = mesh.GetTriangleBlocks();
+
+			//Value-initialized, the slab test loads whole groups of 4 past rayCount
+			alignas(16) float maxDistances[RayPacket::MaxRayCount]{};
+			uint32_t closestBlocks[RayPacket::MaxRayCount];
+			uint32_t closestLanes[RayPacket::MaxRayCount];
+
+			for (uint32_t i = 0; i < packet.rayCount; ++i)
+			{
+				maxDistances[i] = hitRecords[i].t;
+				closestBlocks[i] = UINT32_MAX;
+			}
+
+			float packetMaxDistance = GetMaxDistance(maxDistances, packet.rayCount);
+
+			uint32_t leafCount = 0;
+			bool isDiverged = false;
+
+			TraverseBVH4(mesh.GetBVHNodes(), objectPacket, packetMaxDistance, [&](const BVH4Node& node, uint32_t slot)
+				{
+					if (++leafCount > packet.rayCount)
+					{
+						isDiverged = true;
+						return true;
+					}
+
+					const Vector3 leafMin = GetLeafMin(node, slot);
+					const Vector3 leafMax = GetLeafMax(node, slot);
+					const TriangleBlock& block = blocks[node.child[slot]];
+
+					for (uint32_t first = 0; first < objectPacket.rayCount; first += 4)
+					{
+						uint32_t rayMask = SlabTestPacket_AABB(objectPacket, first, leafMin, leafMax, maxDistances);
+						while (rayMask)
+						{
+							const uint32_t rayIndex = first + std::countr_zero(rayMask);
+							rayMask &= rayMask - 1;
+
+							const Ray objectRay = objectPacket.GetRay(rayIndex);
+
+							float distances[TriangleBlock::Size];
+							uint32_t hitMask = IntersectTriangleBlock(block, objectRay, mesh.cullMode, maxDistances[rayIndex], distances);
+							while (hitMask)
+							{
+								const int lane = std::countr_zero(hitMask);
+								hitMask &= hitMask - 1;
+
+								if (distances[lane] < maxDistances[rayIndex])
+								{
+									maxDistances[rayIndex] = distances[lane];
+									closestBlocks[rayIndex] = node.child[slot];
+									closestLanes[rayIndex] = lane;
+								}
+							}
+						}
+					}
+
+					packetMaxDistance = GetMaxDistance(maxDistances, packet.rayCount);
+					return false;
+				});
+
+			if (isDiverged)
+			{
+				for (uint32_t i = 0; i < packet.rayCount; ++i)
+				{
+					HitTest_TriangleMesh(mesh, packet.GetRay(i), hitRecords[i]);
+				}
+				return;
+			}
+
+			for (uint32_t i = 0; i < packet.rayCount; ++i)
+			{
+				if (closestBlocks[i] == UINT32_MAX)
+					continue;
+
+				const TriangleBlock& block = blocks[closestBlocks[i]];
+				const uint32_t lane = closestLanes[i];
+				const Vector3 normal = { block.normalX[lane], block.normalY[lane], block.normalZ[lane] };
+
+				//Back to world space
+				const Ray ray = packet.GetRay(i);
+
+				HitRecord& hitRecord = hitRecords[i];
+				hitRecord.t = maxDistances[i];
+				hitRecord.origin = ray.origin + ray.direction * maxDistances[i];
+				hitRecord.normal = mesh.normalTransform.TransformVector(normal).Normalized();
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = mesh.materialIndex;
+			}
+		}
+#pragma endregion
+	}
+}
@@ -1,159 +1,1833 @@
-#include "SDL.h"
-#include "SDL_surface.h"
 #include "Renderer.h"
+#include "BVH.h"
+#include "FrameBuffer.h"
 #include "Math.h"
 #include "Matrix.h"
 #include "Material.h"
 #include "Scene.h"
 #include "Utils.h"
-#include <vector>
-#include <execution>
+#include "RayPacket.h"
+#include "Scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <type_traits>
 
 #define PARALLEL_EXECUTION
 using namespace dae;
 
-Renderer::Renderer(SDL_Window* pWindow) :
-	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow)),
-	m_ShadowsEnabled(false),
-	m_Width(0), m_Height(0)
+//First sample of a pixel, kept while anti-aliasing
+struct Renderer::PixelSample
 {
-	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
-	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	ColorRGB color = {};
+	uint32_t objectId = 0;
+	unsigned char materialIndex = 0;
+};
+
+struct Renderer::TemporalSample
+{
+	Vector3 position = {};
+	Vector3 normal = {};
+	ColorRGB color = {};
+	uint32_t objectId = 0;
+	uint16_t sampleCount = 0; //0 until the pixel was rendered
+	bool isReused = false;
+};
+
+struct Renderer::FrameHistory
+{
+	struct PrimaryHit
+	{
+		Vector3 position = {};
+		bool didHit = false;
+	};
+
+	struct ScreenRect
+	{
+		uint32_t x0, y0, x1, y1;
+	};
+
+	bool isValid = false;
+	Vector3 cameraOrigin = {};
+	Matrix cameraToWorld = {};
+	Matrix worldToCamera = {};
+	float fov = 1.f;
+	float aspectRatio = 1.f;
+	std::vector<SceneObjectState> objects{};
+	uint64_t lightsHash = 0;
+	uint64_t settings = 0;
+	uint32_t stride = 0;
+	const uint32_t* pPixels = nullptr; //Render target
+
+	//Of every pixel, valid when stride is 1. Only the rendered tiles overwrite them
+	std::vector<PrimaryHit> primaryHits{};
+
+	//Compared to the current frame, see BeginFrame
+	bool isComparable = false; //Same settings, lights and objects, so what moved is known
+	bool isCameraUnchanged = false; //Every pixel covers what it covered in the previous frame
+	std::vector<AABB> movedBounds{}; //Old and new bounds of everything that moved
+	std::vector<ScreenRect> dirtyRects{}; //Screen space footprint of movedBounds
+};
+
+struct Renderer::TemporalHistory
+{
+	std::vector<TemporalSample> samples[2];
+	int currentIndex = 0; //Written this frame, the other one holds the previous frame
+
+	bool isActive = false; //This frame
+	bool isValid = false; //The other buffer holds a frame rendered with temporal reprojection
+	bool isUsable = false; //...that can be reprojected into this one
+};
+
+//Per render thread, cleared but never shrunk between tiles so nothing is allocated once they are warm
+struct Renderer::WavefrontQueues
+{
+	//Primary rays of at most 8x8 samples traced together, [firstRay, firstRay + rayCount) of the camera rays
+	struct Packet
+	{
+		uint32_t x0, y0, x1, y1;
+		uint32_t firstRay;
+		uint32_t rayCount;
+	};
+
+	//Shadow rays of one light towards the hits of one material, [firstRay, endRay) of the shadow rays
+	struct ShadowRun
+	{
+		uint32_t lightIndex;
+		unsigned char materialIndex;
+		uint32_t firstRay;
+		uint32_t endRay;
+	};
+
+	//CAMERA RAYS, one per sample
+	std::vector<Packet> packets{};
+	std::vector<uint32_t> pixelX{};
+	std::vector<uint32_t> pixelY{};
+	std::vector<float> directionX{};
+	std::vector<float> directionY{};
+	std::vector<float> directionZ{};
+	std::vector<HitRecord> closestHits{}; //Written by the scene, which returns records
+	std::vector<ColorRGB> colors{}; //Accumulated lighting, the final color once resolved
+	std::vector<uint8_t> isReused{};
+	std::vector<const TemporalSample*> previousSamples{};
+
+	//SHADING REQUESTS, the camera rays that hit something and still need shading, sorted by material
+	std::vector<uint32_t> shadingRays{};
+	std::vector<uint32_t> materialCounts{};
+	std::vector<float> viewX{}; //Per camera ray, towards the camera
+	std::vector<float> viewY{};
+	std::vector<float> viewZ{};
+
+	//SHADOW RAYS, light by light and within a light material by material
+	std::vector<ShadowRun> shadowRuns{};
+	std::vector<uint32_t> shadowCameraRays{};
+	std::vector<float> shadowOriginX{};
+	std::vector<float> shadowOriginY{};
+	std::vector<float> shadowOriginZ{};
+	std::vector<float> shadowDirectionX{};
+	std::vector<float> shadowDirectionY{};
+	std::vector<float> shadowDirectionZ{};
+	std::vector<float> shadowDistances{};
+	std::vector<float> cosAngles{};
+	std::vector<float> lightDirectionX{}; //From the hit itself rather than the offset shadow ray origin
+	std::vector<float> lightDirectionY{};
+	std::vector<float> lightDirectionZ{};
+	std::vector<uint8_t> isOccluded{};
+
+	void ClearCameraRays()
+	{
+		packets.clear();
+		pixelX.clear();
+		pixelY.clear();
+		directionX.clear();
+		directionY.clear();
+		directionZ.clear();
+	}
+
+	void ClearShadowRays()
+	{
+		shadowRuns.clear();
+		shadowCameraRays.clear();
+		shadowOriginX.clear();
+		shadowOriginY.clear();
+		shadowOriginZ.clear();
+		shadowDirectionX.clear();
+		shadowDirectionY.clear();
+		shadowDirectionZ.clear();
+		shadowDistances.clear();
+		cosAngles.clear();
+		lightDirectionX.clear();
+		lightDirectionY.clear();
+		lightDirectionZ.clear();
+	}
+
+	Ray GetCameraRay(const Vector3& origin, uint32_t rayIndex) const
+	{
+		return { origin, { directionX[rayIndex], directionY[rayIndex], directionZ[rayIndex] } };
+	}
+};
+
+namespace
+{
+	//Low discrepancy jitter for TAA, in [0, 1)
+	float Halton(uint32_t index, uint32_t base)
+	{
+		float result = 0.f;
+		float fraction = 1.f;
+		while (index > 0)
+		{
+			fraction /= static_cast<float>(base);
+			result += fraction * static_cast<float>(index % base);
+			index /= base;
+		}
+		return result;
+	}
+
+	//Screen space footprint of a box in pixels, with margin pixels around it and clamped to the screen. Returns false when it is off screen.
+	//A box that straddles the camera plane (or is behind it) has no finite footprint and covers the whole screen
+	bool ProjectToScreen(const FrameSnapshot& frame, const Matrix& worldToCamera, const AABB& bounds, float width, float height, float margin,
+		uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1)
+	{
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+		for (uint32_t corner = 0; corner < 8; ++corner)
+		{
+			const Vector3 point
+			{
+				corner & 1 ? bounds.max.x : bounds.min.x,
+				corner & 2 ? bounds.max.y : bounds.min.y,
+				corner & 4 ? bounds.max.z : bounds.min.z
+			};
+
+			const Vector3 cameraSpacePoint = worldToCamera.TransformPoint(point);
+			if (cameraSpacePoint.z <= 0.f)
+			{
+				minX = minY = -FLT_MAX;
+				maxX = maxY = FLT_MAX;
+				break;
+			}
+
+			//The inverse of Renderer::GetViewDirection
+			const float rx = (cameraSpacePoint.x / cameraSpacePoint.z / (frame.aspectRatio * frame.fov) + 1.f) * 0.5f * width;
+			const float ry = (1.f - cameraSpacePoint.y / cameraSpacePoint.z / frame.fov) * 0.5f * height;
+
+			minX = std::min(minX, rx);
+			minY = std::min(minY, ry);
+			maxX = std::max(maxX, rx);
+			maxY = std::max(maxY, ry);
+		}
+
+		minX = std::clamp(minX - margin, 0.f, width);
+		minY = std::clamp(minY - margin, 0.f, height);
+		maxX = std::clamp(maxX + margin, 0.f, width);
+		maxY = std::clamp(maxY + margin, 0.f, height);
+
+		if (minX >= maxX || minY >= maxY)
+			return false;
+
+		x0 = static_cast<uint32_t>(minX);
+		y0 = static_cast<uint32_t>(minY);
+		x1 = static_cast<uint32_t>(std::ceil(maxX));
+		y1 = static_cast<uint32_t>(std::ceil(maxY));
+		return true;
+	}
+
+	//PCG hash, decorrelates the random numbers of neighbouring hits
+	uint32_t Hash(uint32_t value)
+	{
+		const uint32_t state = value * 747796405u + 2891336453u;
+		const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	uint32_t HashPosition(const Vector3& position, uint32_t seed)
+	{
+		return Hash(std::bit_cast<uint32_t>(position.x) ^ Hash(std::bit_cast<uint32_t>(position.y) ^ Hash(std::bit_cast<uint32_t>(position.z) ^ Hash(seed))));
+	}
+
+	//[0, 1) from the upper 24 bits
+	float RandomFloat(uint32_t hash)
+	{
+		return static_cast<float>(hash >> 8) * 0x1p-24f;
+	}
+}
+
+Renderer::Renderer(uint32_t width, uint32_t height, uint32_t threadCount, uint32_t tileSize) :
+	m_pFrameHistory(std::make_unique<FrameHistory>()),
+	m_Width(static_cast<int>(width)), m_Height(static_cast<int>(height)),
+	m_pScheduler(std::make_unique<TileScheduler>(threadCount)),
+	m_TileSize((std::max(tileSize, 1u) + RayPacket::TileSize - 1) / RayPacket::TileSize * RayPacket::TileSize),
+	m_ShadowsEnabled(false)
+{
+	m_pFrameHistory->primaryHits.resize(width * height);
+
+	for (std::unique_ptr<FrameBuffer>& pFrameBuffer : m_pFrameBuffers)
+	{
+		pFrameBuffer = std::make_unique<FrameBuffer>(width, height);
+	}
+
+	std::cout << "Rendering " << m_TileSize << "x" << m_TileSize << " tiles on " << m_pScheduler->GetThreadCount() << " threads" << std::endl;
+}
+
+Renderer::~Renderer() = default;
+
+void Renderer::Render(Scene* pScene)
+{
+	m_pBufferPixels = m_pFrameBuffers[m_FinishedBufferIndex]->GetPixels();
+
+	RenderFrame(pScene);
+}
+
+std::future<void> Renderer::RenderAsync(Scene* pScene)
+{
+	m_pBufferPixels = m_pFrameBuffers[m_FinishedBufferIndex ^ 1]->GetPixels();
+
+	return std::async(std::launch::async, [this, pScene]
+		{
+			RenderFrame(pScene);
+		});
+}
+
+void Renderer::SwapFrameBuffers()
+{
+	m_FinishedBufferIndex ^= 1;
+}
+
+const FrameBuffer& Renderer::GetFrameBuffer() const
+{
+	return *m_pFrameBuffers[m_FinishedBufferIndex];
+}
+
+void Renderer::RenderFrame(Scene* pScene)
+{
+	//Taken once, every tile reads from it
+	const FrameSnapshot frame = pScene->TakeSnapshot(m_Width / static_cast<float>(m_Height));
+
+	uint32_t stride = 1;
+	if (m_ProgressiveEnabled)
+	{
+		if (frame.viewHash != m_ProgressiveViewHash)
+			m_ProgressiveStride = CoarsestStride;
+		else if (m_ProgressiveStride > 1)
+			m_ProgressiveStride /= 2;
+
+		m_ProgressiveViewHash = frame.viewHash;
+		stride = m_ProgressiveStride;
+	}
+
+	const uint32_t tilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	const uint32_t tilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+
+	const auto forEachTile = [&](const std::function<void(uint32_t)>& task)
+		{
+#if defined(PARALLEL_EXECUTION)
+			m_pScheduler->Run(tilesX * tilesY, task);
+#else
+			for (uint32_t tileIndex = 0; tileIndex < tilesX * tilesY; ++tileIndex)
+			{
+				task(tileIndex);
+			}
+#endif
+		};
+
+	BeginFrame(frame);
+	BeginTemporalFrame(stride);
+	BuildTileLightLists(frame);
+	if (m_LightSamplingEnabled)
+	{
+		BuildLightTree(frame);
+		++m_LightSamplingSeed;
+	}
+
+	const FrameHistory& history = *m_pFrameHistory;
+
+	m_DirtyTiles.assign(tilesX * tilesY, 1);
+
+	//Jittered TAA changes every pixel until it converged
+	if (m_DirtyRegionsEnabled && stride == 1 && history.stride == 1 && history.isCameraUnchanged &&
+		m_CurrentTemporalMode != TemporalMode::AntiAliasing)
+	{
+		MarkDirtyTiles(frame);
+		forEachTile([&](uint32_t tileIndex)
+			{
+				m_DirtyTiles[tileIndex] = IsTileDirty(frame, tileIndex);
+			});
+	}
+
+	uint32_t renderedPixels = 0;
+	for (uint32_t tileIndex = 0; tileIndex < tilesX * tilesY; ++tileIndex)
+	{
+		uint32_t x0, y0, x1, y1;
+		GetTileBounds(tileIndex, x0, y0, x1, y1);
+		renderedPixels += m_DirtyTiles[tileIndex] * (x1 - x0) * (y1 - y0);
+	}
+
+	m_DirtyTileRatio = std::count(m_DirtyTiles.begin(), m_DirtyTiles.end(), 1) / static_cast<float>(m_DirtyTiles.size());
+
+	//Nothing changed and the previous frame is still in the buffer
+	if (renderedPixels == 0 && history.pPixels == m_pBufferPixels && !(m_pTemporalHistory && m_pTemporalHistory->isActive))
+	{
+		m_SamplesPerPixel = 0.f;
+		EndFrame(frame, stride);
+		return;
+	}
+
+	//Coarse progressive passes are not worth anti-aliasing
+	m_CollectPixelSamples = m_AntiAliasingEnabled && stride == 1;
+	if (m_CollectPixelSamples && !m_pPixelSamples)
+		m_pPixelSamples = std::make_unique<PixelSample[]>(m_Width * m_Height);
+
+	forEachTile([&](uint32_t tileIndex)
+		{
+			if (m_DirtyTiles[tileIndex])
+				RenderTile(frame, tileIndex, stride);
+			else
+				CopyTile(tileIndex);
+		});
+
+	EndTemporalFrame();
+
+	m_SamplesPerPixel = renderedPixels / static_cast<float>(stride * stride * m_Width * m_Height);
+
+	if (m_CollectPixelSamples)
+	{
+		//Separate pass, edges are found by looking at the first samples of the neighbouring tiles too.
+		//So tiles next to a rendered one are refined again as well
+		const auto isNextToDirtyTile = [&](uint32_t tileIndex)
+			{
+				const uint32_t tileX = tileIndex % tilesX;
+				const uint32_t tileY = tileIndex / tilesX;
+
+				return (tileX > 0 && m_DirtyTiles[tileIndex - 1]) ||
+					(tileX + 1 < tilesX && m_DirtyTiles[tileIndex + 1]) ||
+					(tileY > 0 && m_DirtyTiles[tileIndex - tilesX]) ||
+					(tileY + 1 < tilesY && m_DirtyTiles[tileIndex + tilesX]);
+			};
+
+		std::atomic<uint32_t> refinedPixels{ 0 };
+		forEachTile([&](uint32_t tileIndex)
+			{
+				if (m_DirtyTiles[tileIndex])
+					refinedPixels += RefineTile(frame, tileIndex);
+				else if (isNextToDirtyTile(tileIndex))
+					refinedPixels += RefineTile(frame, tileIndex, true);
+			});
+
+		m_SamplesPerPixel += refinedPixels * (AntiAliasingGrid * AntiAliasingGrid - 1) / static_cast<float>(m_Width * m_Height);
+	}
+
+	EndFrame(frame, stride);
+}
+
+void Renderer::BeginFrame(const FrameSnapshot& frame)
+{
+	FrameHistory& history = *m_pFrameHistory;
+
+	history.isComparable = history.isValid &&
+		history.settings == GetSettings() &&
+		history.lightsHash == frame.lightsHash &&
+		history.objects.size() == frame.objects.size();
+
+	history.isCameraUnchanged = history.isComparable &&
+		std::memcmp(&history.cameraOrigin, &frame.cameraOrigin, sizeof(Vector3)) == 0 &&
+		std::memcmp(&history.cameraToWorld, &frame.cameraToWorld, sizeof(Matrix)) == 0 &&
+		history.fov == frame.fov &&
+		history.aspectRatio == frame.aspectRatio;
+
+	history.movedBounds.clear();
+	if (history.isComparable)
+	{
+		for (size_t i = 0; i < frame.objects.size(); ++i)
+		{
+			if (frame.objects[i].hash == history.objects[i].hash)
+				continue;
+
+			AABB bounds = history.objects[i].bounds;
+			bounds.Grow(frame.objects[i].bounds);
+			history.movedBounds.push_back(bounds);
+		}
+	}
+}
+
+void Renderer::EndFrame(const FrameSnapshot& frame, uint32_t stride)
+{
+	FrameHistory& history = *m_pFrameHistory;
+
+	history.isValid = true;
+	history.cameraOrigin = frame.cameraOrigin;
+	history.cameraToWorld = frame.cameraToWorld;
+	history.worldToCamera = Matrix::Inverse(frame.cameraToWorld);
+	history.fov = frame.fov;
+	history.aspectRatio = frame.aspectRatio;
+	history.objects.assign(frame.objects.begin(), frame.objects.end());
+	history.lightsHash = frame.lightsHash;
+	history.settings = GetSettings();
+	history.stride = stride;
+	history.pPixels = m_pBufferPixels;
+}
+
+uint64_t Renderer::GetSettings() const
+{
+	//Every field has its own bits, so different settings never share a key
+	static_assert(MaxLightSampleCount < (1u << 26), "The light sample count must fit below the cutoff bits");
+
+	return static_cast<uint64_t>(m_ShadowsEnabled) |
+		static_cast<uint64_t>(m_AntiAliasingEnabled) << 1 |
+		static_cast<uint64_t>(m_CurrentLightingMode) << 2 |
+		static_cast<uint64_t>(m_CurrentTemporalMode) << 4 |
+		static_cast<uint64_t>(m_LightSamplingEnabled ? m_LightSampleCount : 0) << 6 |
+		static_cast<uint64_t>(std::bit_cast<uint32_t>(m_LightCutoff)) << 32;
+}
+
+void Renderer::MarkDirtyTiles(const FrameSnapshot& frame)
+{
+	FrameHistory& history = *m_pFrameHistory;
+	history.dirtyRects.clear();
+
+	const Matrix worldToCamera = Matrix::Inverse(frame.cameraToWorld);
+
+	//Pixels whose primary ray crosses something that moved.
+	//A pixel of margin, anti-aliasing samples cover the whole pixel
+	for (const AABB& bounds : history.movedBounds)
+	{
+		FrameHistory::ScreenRect rect{};
+		if (ProjectToScreen(frame, worldToCamera, bounds, static_cast<float>(m_Width), static_cast<float>(m_Height), 1.f, rect.x0, rect.y0, rect.x1, rect.y1))
+			history.dirtyRects.push_back(rect);
+	}
+}
+
+bool Renderer::IsTileDirty(const FrameSnapshot& frame, uint32_t tileIndex) const
+{
+	const FrameHistory& history = *m_pFrameHistory;
+
+	uint32_t tileX0, tileY0, tileX1, tileY1;
+	GetTileBounds(tileIndex, tileX0, tileY0, tileX1, tileY1);
+
+	for (const FrameHistory::ScreenRect& rect : history.dirtyRects)
+	{
+		if (rect.x0 < tileX1 && tileX0 < rect.x1 && rect.y0 < tileY1 && tileY0 < rect.y1)
+			return true;
+	}
+
+	//Shadow receivers: surfaces seen in this tile whose shadow rays cross something that moved
+	if (!m_ShadowsEnabled || history.movedBounds.empty())
+		return false;
+
+	for (uint32_t py = tileY0; py < tileY1; ++py)
+	{
+		for (uint32_t px = tileX0; px < tileX1; ++px)
+		{
+			const FrameHistory::PrimaryHit& hit = history.primaryHits[px + (py * m_Width)];
+			if (hit.didHit && IsAffectedByMovedObjects(frame, hit.position))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void Renderer::CopyTile(uint32_t tileIndex) const
+{
+	const FrameHistory& history = *m_pFrameHistory;
+
+	uint32_t tileX0, tileY0, tileX1, tileY1;
+	GetTileBounds(tileIndex, tileX0, tileY0, tileX1, tileY1);
+
+	for (uint32_t py = tileY0; py < tileY1; ++py)
+	{
+		const uint32_t rowStart = tileX0 + (py * m_Width);
+
+		if (history.pPixels != m_pBufferPixels)
+			std::copy_n(history.pPixels + rowStart, tileX1 - tileX0, m_pBufferPixels + rowStart);
+
+		if (m_pTemporalHistory && m_pTemporalHistory->isActive)
+		{
+			TemporalHistory& temporalHistory = *m_pTemporalHistory;
+			std::copy_n(temporalHistory.samples[temporalHistory.currentIndex ^ 1].begin() + rowStart, tileX1 - tileX0,
+				temporalHistory.samples[temporalHistory.currentIndex].begin() + rowStart);
+		}
+	}
+}
+
+float Renderer::GetActiveLightCutoff() const
+{
+	//Only radiance falls off with distance, the observed area and BRDF modes shade a light the same at any distance
+	return m_CurrentLightingMode == LightingMode::Radiance || m_CurrentLightingMode == LightingMode::Combined ? m_LightCutoff : 0.f;
+}
+
+void Renderer::BuildTileLightLists(const FrameSnapshot& frame)
+{
+	const uint32_t tilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	const uint32_t tilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+	const uint32_t tileCount = tilesX * tilesY;
+	const uint32_t lightCount = static_cast<uint32_t>(frame.lights.size());
+
+	const float cutoff = GetActiveLightCutoff();
+
+	//radiance = brightest * intensity / distance^2 drops below the cutoff at distance^2 = brightest * intensity / cutoff
+	m_LightRadiiSquared.resize(lightCount);
+	for (uint32_t lightIndex = 0; lightIndex < lightCount; ++lightIndex)
+	{
+		const Light& light = frame.lights[lightIndex];
+		const float brightest = std::max({ light.color.r, light.color.g, light.color.b }) * light.intensity;
+
+		m_LightRadiiSquared[lightIndex] = cutoff > 0.f && light.type == LightType::Point ?
+			brightest / cutoff :
+			std::numeric_limits<float>::infinity();
+	}
+
+	//Tile range [x0, x1) x [y0, y1) every light covers, counted first and then written, so the lists end up flat
+	struct TileRect
+	{
+		uint32_t x0, y0, x1, y1;
+	};
+
+	std::vector<TileRect> lightTiles(lightCount, TileRect{ 0, 0, tilesX, tilesY });
+
+	if (cutoff > 0.f)
+	{
+		const Matrix worldToCamera = Matrix::Inverse(frame.cameraToWorld);
+
+		for (uint32_t lightIndex = 0; lightIndex < lightCount; ++lightIndex)
+		{
+			if (std::isinf(m_LightRadiiSquared[lightIndex]))
+				continue;
+
+			const Vector3& origin = frame.lights[lightIndex].origin;
+			const float radius = std::sqrt(m_LightRadiiSquared[lightIndex]);
+			const Vector3 extent{ radius, radius, radius };
+
+			//A pixel of margin, anti-aliasing samples cover the whole pixel
+			uint32_t x0, y0, x1, y1;
+			if (!ProjectToScreen(frame, worldToCamera, AABB{ origin - extent, origin + extent },
+				static_cast<float>(m_Width), static_cast<float>(m_Height), 1.f, x0, y0, x1, y1))
+			{
+				lightTiles[lightIndex] = {};
+				continue;
+			}
+
+			lightTiles[lightIndex] = { x0 / m_TileSize, y0 / m_TileSize, (x1 + m_TileSize - 1) / m_TileSize, (y1 + m_TileSize - 1) / m_TileSize };
+		}
+	}
+
+	m_TileLightOffsets.assign(tileCount + 1, 0);
+	for (const TileRect& rect : lightTiles)
+	{
+		for (uint32_t tileY = rect.y0; tileY < rect.y1; ++tileY)
+		{
+			for (uint32_t tileX = rect.x0; tileX < rect.x1; ++tileX)
+			{
+				++m_TileLightOffsets[tileX + (tileY * tilesX) + 1];
+			}
+		}
+	}
+
+	for (uint32_t tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+	{
+		m_TileLightOffsets[tileIndex + 1] += m_TileLightOffsets[tileIndex];
+	}
+
+	m_TileLightIndices.resize(m_TileLightOffsets.back());
+
+	std::vector<uint32_t> tileLightCounts(tileCount, 0);
+	for (uint32_t lightIndex = 0; lightIndex < lightCount; ++lightIndex)
+	{
+		const TileRect& rect = lightTiles[lightIndex];
+		for (uint32_t tileY = rect.y0; tileY < rect.y1; ++tileY)
+		{
+			for (uint32_t tileX = rect.x0; tileX < rect.x1; ++tileX)
+			{
+				const uint32_t tileIndex = tileX + (tileY * tilesX);
+				m_TileLightIndices[m_TileLightOffsets[tileIndex] + tileLightCounts[tileIndex]++] = lightIndex;
+			}
+		}
+	}
+
+	m_TileLightRatio = lightCount > 0 ? m_TileLightIndices.size() / static_cast<float>(tileCount * lightCount) : 1.f;
+}
+
+std::span<const uint32_t> Renderer::GetTileLights(uint32_t px, uint32_t py) const
+{
+	const uint32_t tilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	const uint32_t tileIndex = px / m_TileSize + (py / m_TileSize) * tilesX;
+
+	return std::span<const uint32_t>(m_TileLightIndices).subspan(m_TileLightOffsets[tileIndex], m_TileLightOffsets[tileIndex + 1] - m_TileLightOffsets[tileIndex]);
+}
+
+void Renderer::GetTileBounds(uint32_t tileIndex, uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1) const
+{
+	const uint32_t tilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+
+	x0 = (tileIndex % tilesX) * m_TileSize;
+	y0 = (tileIndex / tilesX) * m_TileSize;
+	x1 = std::min(x0 + m_TileSize, static_cast<uint32_t>(m_Width));
+	y1 = std::min(y0 + m_TileSize, static_cast<uint32_t>(m_Height));
+}
+
+void Renderer::RenderPixel(const FrameSnapshot& frame, uint32_t px, uint32_t py, uint32_t stride) const
+{
+	//Blocks are cut off at the edges of the screen, the ray goes through the center of what is left
+	const uint32_t blockWidth = std::min(stride, static_cast<uint32_t>(m_Width) - px);
+	const uint32_t blockHeight = std::min(stride, static_cast<uint32_t>(m_Height) - py);
+
+	const Ray viewRay = Ray(frame.cameraOrigin, GetViewDirection(frame, px + m_SampleOffsetX * blockWidth, py + m_SampleOffsetY * blockHeight));
+
+	HitRecord closestHit = {};
+	frame.pScene->GetClosestHit(viewRay, closestHit);
+
+	ShadePixel(frame, px, py, viewRay, closestHit);
+
+	if (stride > 1)
+		FillBlock(px, py, blockWidth, blockHeight);
+}
+
+void Renderer::RenderTile(const FrameSnapshot& frame, uint32_t tileIndex, uint32_t stride) const
+{
+	uint32_t tileX0, tileY0, tileX1, tileY1;
+	GetTileBounds(tileIndex, tileX0, tileY0, tileX1, tileY1);
+
+	//The wavefront stages trace shadow rays light by light, light sampling picks other lights for every hit
+	if (m_WavefrontEnabled && !m_LightSamplingEnabled)
+	{
+		RenderWavefront(frame, tileX0, tileY0, tileX1, tileY1, stride);
+		return;
+	}
+
+	if (!m_PacketTracingEnabled)
+	{
+		for (uint32_t py = tileY0; py < tileY1; py += stride)
+		{
+			for (uint32_t px = tileX0; px < tileX1; px += stride)
+			{
+				RenderPixel(frame, px, py, stride);
+			}
+		}
+		return;
+	}
+
+	//Tiles are a multiple of the packet size, and so of every stride
+	const uint32_t packetSize = RayPacket::TileSize * stride;
+
+	for (uint32_t y0 = tileY0; y0 < tileY1; y0 += packetSize)
+	{
+		for (uint32_t x0 = tileX0; x0 < tileX1; x0 += packetSize)
+		{
+			const uint32_t x1 = std::min(x0 + packetSize, tileX1);
+			const uint32_t y1 = std::min(y0 + packetSize, tileY1);
+
+			RenderPacket(frame, x0, y0, x1, y1, stride);
+		}
+	}
+}
+
+void Renderer::RenderRegion(Scene* pScene, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	const FrameSnapshot frame = pScene->TakeSnapshot(m_Width / static_cast<float>(m_Height));
+
+	m_pBufferPixels = m_pFrameBuffers[m_FinishedBufferIndex]->GetPixels();
+	m_CollectPixelSamples = false;
+	BuildTileLightLists(frame);
+	if (m_LightSamplingEnabled)
+		BuildLightTree(frame);
+
+	//Nothing else of the frame is rendered, so the next Render can not build on it
+	m_pFrameHistory->isValid = false;
+	if (m_pTemporalHistory)
+	{
+		m_pTemporalHistory->isActive = false;
+		m_pTemporalHistory->isValid = false;
+	}
+
+	const uint32_t blocksX = (x1 - x0 + RayPacket::TileSize - 1) / RayPacket::TileSize;
+	const uint32_t blocksY = (y1 - y0 + RayPacket::TileSize - 1) / RayPacket::TileSize;
+
+	m_pScheduler->Run(blocksX * blocksY, [&](uint32_t blockIndex)
+		{
+			const uint32_t blockX0 = x0 + (blockIndex % blocksX) * RayPacket::TileSize;
+			const uint32_t blockY0 = y0 + (blockIndex / blocksX) * RayPacket::TileSize;
+			const uint32_t blockX1 = std::min(blockX0 + RayPacket::TileSize, x1);
+			const uint32_t blockY1 = std::min(blockY0 + RayPacket::TileSize, y1);
+
+			if (m_PacketTracingEnabled)
+			{
+				RenderPacket(frame, blockX0, blockY0, blockX1, blockY1);
+				return;
+			}
+
+			for (uint32_t py = blockY0; py < blockY1; ++py)
+			{
+				for (uint32_t px = blockX0; px < blockX1; ++px)
+				{
+					RenderPixel(frame, px, py);
+				}
+			}
+		});
+
+	m_SamplesPerPixel = 1.f;
+}
+
+void Renderer::RenderPacket(const FrameSnapshot& frame, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t stride) const
+{
+	RayPacket packet{};
+	packet.origin = frame.cameraOrigin;
+
+	for (uint32_t py = y0; py < y1; py += stride)
+	{
+		for (uint32_t px = x0; px < x1; px += stride)
+		{
+			packet.AddRay(GetViewDirection(frame, px + m_SampleOffsetX * std::min(stride, x1 - px), py + m_SampleOffsetY * std::min(stride, y1 - py)));
+		}
+	}
+
+	//Pixel corners rather than centers, so every ray is strictly inside the frustum
+	const Vector3 corners[4] =
+	{
+		GetViewDirection(frame, static_cast<float>(x0), static_cast<float>(y0)),
+		GetViewDirection(frame, static_cast<float>(x1), static_cast<float>(y0)),
+		GetViewDirection(frame, static_cast<float>(x1), static_cast<float>(y1)),
+		GetViewDirection(frame, static_cast<float>(x0), static_cast<float>(y1))
+	};
+	packet.Finalize(corners);
+
+	HitRecord closestHits[RayPacket::MaxRayCount] = {};
+	frame.pScene->GetClosestHits(packet, closestHits);
+
+	uint32_t rayIndex = 0;
+	for (uint32_t py = y0; py < y1; py += stride)
+	{
+		for (uint32_t px = x0; px < x1; px += stride, ++rayIndex)
+		{
+			ShadePixel(frame, px, py, packet.GetRay(rayIndex), closestHits[rayIndex]);
+
+			if (stride > 1)
+				FillBlock(px, py, std::min(stride, x1 - px), std::min(stride, y1 - py));
+		}
+	}
+}
+
+Vector3 Renderer::GetViewDirection(const FrameSnapshot& frame, float rx, float ry) const
+{
+	const float cx = (2.f * rx / static_cast<float>(m_Width) - 1.f) * frame.aspectRatio * frame.fov;
+	const float cy = (1.f - (2.f * ry) / static_cast<float>(m_Height)) * frame.fov;
+
+	return frame.cameraToWorld.TransformVector({ cx, cy, 1 });
+}
+
+uint32_t Renderer::RefineTile(const FrameSnapshot& frame, uint32_t tileIndex, bool restoreFirstSamples) const
+{
+	uint32_t tileX0, tileY0, tileX1, tileY1;
+	GetTileBounds(tileIndex, tileX0, tileY0, tileX1, tileY1);
+
+	constexpr uint32_t subsampleCount = AntiAliasingGrid * AntiAliasingGrid - 1;
+	static_assert(subsampleCount <= RayPacket::MaxRayCount);
+
+	const std::span<const uint32_t> lightIndices = GetTileLights(tileX0, tileY0);
+
+	uint32_t refinedPixels = 0;
+
+	for (uint32_t py = tileY0; py < tileY1; ++py)
+	{
+		for (uint32_t px = tileX0; px < tileX1; ++px)
+		{
+			if (!NeedsRefinement(px, py))
+			{
+				if (restoreFirstSamples)
+					WritePixel(px, py, m_pPixelSamples[px + (py * m_Width)].color);
+				continue;
+			}
+
+			//Every stratum but the center one, which is where the first sample went
+			RayPacket packet{};
+			packet.origin = frame.cameraOrigin;
+
+			for (uint32_t sy = 0; sy < AntiAliasingGrid; ++sy)
+			{
+				for (uint32_t sx = 0; sx < AntiAliasingGrid; ++sx)
+				{
+					if (sx == AntiAliasingGrid / 2 && sy == AntiAliasingGrid / 2)
+						continue;
+
+					packet.AddRay(GetViewDirection(frame,
+						px + (sx + 0.5f) / AntiAliasingGrid,
+						py + (sy + 0.5f) / AntiAliasingGrid));
+				}
+			}
+
+			HitRecord closestHits[subsampleCount] = {};
+
+			if (m_PacketTracingEnabled)
+			{
+				const float x = static_cast<float>(px);
+				const float y = static_cast<float>(py);
+				const Vector3 corners[4] =
+				{
+					GetViewDirection(frame, x, y),
+					GetViewDirection(frame, x + 1.f, y),
+					GetViewDirection(frame, x + 1.f, y + 1.f),
+					GetViewDirection(frame, x, y + 1.f)
+				};
+				packet.Finalize(corners);
+
+				frame.pScene->GetClosestHits(packet, closestHits);
+			}
+			else
+			{
+				for (uint32_t i = 0; i < subsampleCount; ++i)
+				{
+					frame.pScene->GetClosestHit(packet.GetRay(i), closestHits[i]);
+				}
+			}
+
+			ColorRGB color = m_pPixelSamples[px + (py * m_Width)].color;
+			for (uint32_t i = 0; i < subsampleCount; ++i)
+			{
+				color += Shade(frame, lightIndices, packet.GetRay(i), closestHits[i]);
+			}
+			color /= static_cast<float>(subsampleCount + 1);
+
+			WritePixel(px, py, color);
+			++refinedPixels;
+		}
+	}
+
+	return refinedPixels;
+}
+
+bool Renderer::NeedsRefinement(uint32_t px, uint32_t py) const
+{
+	const PixelSample& sample = m_pPixelSamples[px + (py * m_Width)];
+
+	const auto isEdge = [&](uint32_t x, uint32_t y)
+		{
+			const PixelSample& neighbour = m_pPixelSamples[x + (y * m_Width)];
+
+			if (neighbour.objectId != sample.objectId || neighbour.materialIndex != sample.materialIndex)
+				return true;
+
+			return std::abs(neighbour.color.r - sample.color.r) > AntiAliasingContrast ||
+				std::abs(neighbour.color.g - sample.color.g) > AntiAliasingContrast ||
+				std::abs(neighbour.color.b - sample.color.b) > AntiAliasingContrast;
+		};
+
+	return (px > 0 && isEdge(px - 1, py)) ||
+		(px + 1 < static_cast<uint32_t>(m_Width) && isEdge(px + 1, py)) ||
+		(py > 0 && isEdge(px, py - 1)) ||
+		(py + 1 < static_cast<uint32_t>(m_Height) && isEdge(px, py + 1));
+}
+
+void Renderer::ShadePixel(const FrameSnapshot& frame, uint32_t px, uint32_t py, const Ray& viewRay, const HitRecord& closestHit) const
+{
+	const ColorRGB color = m_pTemporalHistory && m_pTemporalHistory->isActive ?
+		ShadeTemporal(frame, px, py, viewRay, closestHit) :
+		Shade(frame, GetTileLights(px, py), viewRay, closestHit);
+
+	StorePixel(px, py, closestHit, color);
+}
+
+void Renderer::StorePixel(uint32_t px, uint32_t py, const HitRecord& closestHit, const ColorRGB& color) const
+{
+	WritePixel(px, py, color);
+
+	m_pFrameHistory->primaryHits[px + (py * m_Width)] = { closestHit.origin, closestHit.didHit };
+
+	if (m_CollectPixelSamples)
+		m_pPixelSamples[px + (py * m_Width)] = { color, closestHit.objectId, closestHit.materialIndex };
+}
+
+void Renderer::BeginTemporalFrame(uint32_t stride)
+{
+	m_SampleOffsetX = 0.5f;
+	m_SampleOffsetY = 0.5f;
+
+	//Coarse progressive passes have nothing to reproject
+	if (m_CurrentTemporalMode == TemporalMode::Off || stride > 1)
+	{
+		if (m_pTemporalHistory)
+		{
+			m_pTemporalHistory->isActive = false;
+			m_pTemporalHistory->isValid = false;
+		}
+		return;
+	}
+
+	if (!m_pTemporalHistory)
+	{
+		m_pTemporalHistory = std::make_unique<TemporalHistory>();
+		for (std::vector<TemporalSample>& samples : m_pTemporalHistory->samples)
+		{
+			samples.resize(m_Width * m_Height);
+		}
+	}
+
+	TemporalHistory& history = *m_pTemporalHistory;
+
+	history.isActive = true;
+	history.isUsable = history.isValid && m_pFrameHistory->isComparable && m_pFrameHistory->stride == 1;
+
+	if (m_CurrentTemporalMode == TemporalMode::AntiAliasing)
+	{
+		++m_FrameIndex;
+		m_SampleOffsetX = Halton(m_FrameIndex % TemporalSampleCount + 1, 2);
+		m_SampleOffsetY = Halton(m_FrameIndex % TemporalSampleCount + 1, 3);
+	}
+}
+
+void Renderer::EndTemporalFrame()
+{
+	m_ReusedPixelRatio = 0.f;
+
+	if (!m_pTemporalHistory || !m_pTemporalHistory->isActive)
+		return;
+
+	TemporalHistory& history = *m_pTemporalHistory;
+
+	const std::vector<TemporalSample>& samples = history.samples[history.currentIndex];
+	const size_t reusedPixels = std::count_if(samples.begin(), samples.end(), [](const TemporalSample& sample) { return sample.isReused; });
+	m_ReusedPixelRatio = reusedPixels / static_cast<float>(samples.size());
+
+	history.currentIndex ^= 1;
+	history.isValid = true;
+}
+
+ColorRGB Renderer::ShadeTemporal(const FrameSnapshot& frame, uint32_t px, uint32_t py, const Ray& viewRay, const HitRecord& closestHit) const
+{
+	const TemporalSample* pPrevious = nullptr;
+	if (ReprojectTemporalSample(frame, px, py, closestHit, pPrevious))
+		return pPrevious->color;
+
+	return AccumulateTemporalSample(px, py, pPrevious, Shade(frame, GetTileLights(px, py), viewRay, closestHit));
+}
+
+bool Renderer::ReprojectTemporalSample(const FrameSnapshot& frame, uint32_t px, uint32_t py, const HitRecord& closestHit, const TemporalSample*& pPrevious) const
+{
+	TemporalHistory& history = *m_pTemporalHistory;
+
+	const uint32_t targetSampleCount = m_CurrentTemporalMode == TemporalMode::AntiAliasing ? TemporalSampleCount : 1;
+
+	pPrevious = FindHistorySample(frame, px, py, closestHit);
+
+	TemporalSample& sample = history.samples[history.currentIndex][px + (py * m_Width)];
+	sample.position = closestHit.origin;
+	sample.normal = closestHit.normal;
+	sample.objectId = closestHit.objectId;
+	sample.isReused = pPrevious && pPrevious->sampleCount >= targetSampleCount;
+
+	if (sample.isReused)
+	{
+		sample.color = pPrevious->color;
+		sample.sampleCount = pPrevious->sampleCount;
+	}
+
+	return sample.isReused;
+}
+
+ColorRGB Renderer::AccumulateTemporalSample(uint32_t px, uint32_t py, const TemporalSample* pPrevious, const ColorRGB& color) const
+{
+	TemporalHistory& history = *m_pTemporalHistory;
+
+	TemporalSample& sample = history.samples[history.currentIndex][px + (py * m_Width)];
+	sample.color = color;
+	sample.sampleCount = 1;
+
+	if (pPrevious)
+	{
+		//Running average of the jittered samples
+		const float previousWeight = static_cast<float>(pPrevious->sampleCount);
+		sample.color = (pPrevious->color * previousWeight + sample.color) * (1.f / (previousWeight + 1.f));
+		sample.sampleCount = pPrevious->sampleCount + 1;
+	}
+
+	return sample.color;
+}
+
+const Renderer::TemporalSample* Renderer::FindHistorySample(const FrameSnapshot& frame, uint32_t px, uint32_t py, const HitRecord& closestHit) const
+{
+	const TemporalHistory& temporalHistory = *m_pTemporalHistory;
+	const FrameHistory& history = *m_pFrameHistory;
+
+	if (!temporalHistory.isUsable)
+		return nullptr;
+
+	const std::vector<TemporalSample>& previousSamples = temporalHistory.samples[temporalHistory.currentIndex ^ 1];
+
+	const Vector3& position = closestHit.origin;
+
+	//Same pixel footprint, the jittered samples of TAA may hit another object every frame along edges,
+	//only what moved in the meantime invalidates the pixel
+	if (history.isCameraUnchanged)
+	{
+		const TemporalSample& previous = previousSamples[px + (py * m_Width)];
+
+		if (previous.sampleCount == 0 ||
+			(closestHit.didHit && IsAffectedByMovedObjects(frame, position)) ||
+			(previous.objectId != 0 && IsAffectedByMovedObjects(frame, previous.position)))
+			return nullptr;
+
+		return &previous;
+	}
+
+	if (!closestHit.didHit)
+		return nullptr;
+
+	//Into the previous frame, the inverse of GetViewDirection
+	const Vector3 cameraSpacePosition = history.worldToCamera.TransformPoint(position);
+	if (cameraSpacePosition.z <= 0.f)
+		return nullptr;
+
+	const float cx = cameraSpacePosition.x / cameraSpacePosition.z;
+	const float cy = cameraSpacePosition.y / cameraSpacePosition.z;
+	const float rx = (cx / (history.aspectRatio * history.fov) + 1.f) * 0.5f * static_cast<float>(m_Width);
+	const float ry = (1.f - cy / history.fov) * 0.5f * static_cast<float>(m_Height);
+
+	if (rx < 0.f || ry < 0.f || rx >= static_cast<float>(m_Width) || ry >= static_cast<float>(m_Height))
+		return nullptr;
+
+	const TemporalSample& previous = previousSamples[static_cast<uint32_t>(rx) + static_cast<uint32_t>(ry) * m_Width];
+
+	//Same surface: object, depth and orientation
+	if (previous.sampleCount == 0 || previous.objectId != closestHit.objectId)
+		return nullptr;
+
+	const float depth = (position - history.cameraOrigin).Magnitude();
+	const float previousDepth = (previous.position - history.cameraOrigin).Magnitude();
+	if (std::abs(depth - previousDepth) > 0.01f * previousDepth)
+		return nullptr;
+
+	if (Vector3::Dot(previous.normal, closestHit.normal) < 0.95f)
+		return nullptr;
+
+	//Specular shading depends on the view direction
+	const Vector3 previousView = (position - history.cameraOrigin) / depth;
+	const Vector3 view = (position - frame.cameraOrigin).Normalized();
+	if (Vector3::Dot(previousView, view) < 0.9999f)
+		return nullptr;
+
+	if (IsAffectedByMovedObjects(frame, position))
+		return nullptr;
+
+	return &previous;
 }
 
-void Renderer::Render(Scene* pScene) const
+bool Renderer::IsAffectedByMovedObjects(const FrameSnapshot& frame, const Vector3& position) const
 {
-	Camera& camera = pScene->GetCamera();
+	//Nothing that moved may cover the point, nor its shadow rays
+	for (const AABB& bounds : m_pFrameHistory->movedBounds)
+	{
+		if (position.x >= bounds.min.x && position.y >= bounds.min.y && position.z >= bounds.min.z &&
+			position.x <= bounds.max.x && position.y <= bounds.max.y && position.z <= bounds.max.z)
+			return true;
 
-	const float aspectRatio = m_Width / static_cast<float>(m_Height);
+		if (!m_ShadowsEnabled)
+			continue;
 
-	const float FOV = tan((dae::TO_RADIANS * camera.fovAngle) / 2);
+		for (const Light& light : frame.lights)
+		{
+			Vector3 directionToLight = light.type == LightType::Directional ? -light.direction : light.origin - position;
+			const float distance = light.type == LightType::Directional ? FLT_MAX : directionToLight.Normalize();
+			if (light.type == LightType::Directional)
+				directionToLight.Normalize();
 
-	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
+			const Ray shadowRay{ position, directionToLight, 0.f, distance };
+			const Vector3 invDirection{ 1.f / directionToLight.x, 1.f / directionToLight.y, 1.f / directionToLight.z };
 
-	const uint32_t amountOfPixels = uint32_t(m_Width * m_Height);
+			if (GeometryUtils::SlabTest_AABB(bounds.min, bounds.max, shadowRay, invDirection, distance) != FLT_MAX)
+				return true;
+		}
+	}
 
-#if defined(PARALLEL_EXECUTION)
+	return false;
+}
 
-	std::vector<uint32_t> pixelIndices{};
+ColorRGB Renderer::Shade(const FrameSnapshot& frame, std::span<const uint32_t> lightIndices, const Ray& viewRay, const HitRecord& closestHit) const
+{
+	const Vector3 v = viewRay.direction.Normalized() * (-1.0f);
 
-	pixelIndices.reserve(amountOfPixels);
+	ColorRGB finalColor = {};
 
-	for (uint32_t index = 0; index < amountOfPixels; ++index) pixelIndices.emplace_back(index);
+	if (closestHit.didHit)
+	{
+		const Material& material = frame.materials[closestHit.materialIndex];
 
-	std::for_each(std::execution::par, pixelIndices.begin(), pixelIndices.end(), [&](int i)
+		if (m_LightSamplingEnabled)
 		{
-			RenderPixel(pScene, i, FOV, aspectRatio, cameraToWorld, camera.origin);
-		});
+			finalColor = SampleLights(frame, material, v, closestHit);
+		}
+		else
+		{
+			for (const uint32_t lightIndex : lightIndices)
+			{
+				finalColor += ShadeLight(frame, material, lightIndex, v, closestHit);
+			}
+		}
+	}
 
-#else
-	for (uint32_t pixelIndex = 0; pixelIndex < amountOfPixels; pixelIndex++)
+	finalColor.MaxToOne();
+
+	return finalColor;
+}
+
+ColorRGB Renderer::ShadeLight(const FrameSnapshot& frame, const Material& material, uint32_t lightIndex, const Vector3& v, const HitRecord& closestHit) const
+{
+	const Light& light = frame.lights[lightIndex];
+
+	if ((light.origin - closestHit.origin).SqrMagnitude() > m_LightRadiiSquared[lightIndex])
+		return {};
+
+	const Vector3 startingPoint = closestHit.origin + closestHit.normal * 0.001f;
+	const Vector3 directionHitToLight = light.origin - startingPoint;
+
+	const float distance = directionHitToLight.Magnitude();
+
+	const Vector3 l = (light.origin - closestHit.origin).Normalized();
+
+	Ray lightRay
+	{
+		startingPoint,
+		directionHitToLight.Normalized(),
+		0.0001f,
+		distance
+	};
+
+	lightRay.max = distance;
+
+	const float cosAngle = Vector3::Dot(closestHit.normal, lightRay.direction);
+
+	if (m_ShadowsEnabled && frame.pScene->DoesHit(lightRay, lightIndex)) return {};
+
+	switch (m_CurrentLightingMode)
 	{
-		RenderPixel(pScene, pixelIndex, FOV, aspectRatio, cameraToWorld, camera.origin);
+	case LightingMode::ObservedArea:
+
+		if (cosAngle < 0) return {};
+
+		return ColorRGB{ cosAngle, cosAngle, cosAngle };
+
+	case LightingMode::Radiance:
+
+		return LightUtils::GetRadiance(light, closestHit.origin);
+
+	case LightingMode::BRDF:
+
+		return ShadeMaterial(material, closestHit, l, v);
+
+	case LightingMode::Combined:
+
+		if (cosAngle < 0) return {};
+
+		return (LightUtils::GetRadiance(light, closestHit.origin) *
+			ShadeMaterial(material, closestHit, l, v) *
+			cosAngle);
+	}
+
+	return {};
+}
+
+ColorRGB Renderer::SampleLights(const FrameSnapshot& frame, const Material& material, const Vector3& v, const HitRecord& closestHit) const
+{
+	ColorRGB color = {};
+
+	for (const uint32_t lightIndex : m_UnsampledLights)
+	{
+		color += ShadeLight(frame, material, lightIndex, v, closestHit);
+	}
+
+	//The samples split [0, 1) in equal strata, one random offset per hit shifts all of them
+	const float sampleWeight = 1.f / static_cast<float>(m_LightSampleCount);
+	const float offset = RandomFloat(HashPosition(closestHit.origin, m_LightSamplingSeed));
+
+	for (uint32_t sampleIndex = 0; sampleIndex < m_LightSampleCount; ++sampleIndex)
+	{
+		uint32_t sampledLight;
+		float probability;
+		//Only fails where no light reaches, this sample then adds nothing
+		if (!m_pLightTree->Sample(closestHit.origin, (sampleIndex + offset) * sampleWeight, sampledLight, probability))
+			continue;
+
+		color += ShadeLight(frame, material, m_SampledLights[sampledLight], v, closestHit) * (sampleWeight / probability);
 	}
-#endif
-	SDL_UpdateWindowSurface(m_pWindow);
 
+	return color;
 }
 
-void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix cameraToWWorld, const Vector3 cameraToOrigin) const
+void Renderer::BuildLightTree(const FrameSnapshot& frame)
 {
-	const std::vector<dae::Material*> materials = pScene->GetMaterials();
-	const std::vector<dae::Light> lights = pScene->GetLights();
+	//The influence radii come from the cutoff, see BuildTileLightLists
+	const float cutoff = GetActiveLightCutoff();
+	if (m_pLightTree && m_LightTreeHash == frame.lightsHash && m_LightTreeCutoff == cutoff)
+		return;
 
-	const uint32_t px = pixelIndex % m_Width;
-	const uint32_t py = pixelIndex / m_Width;
+	if (!m_pLightTree)
+		m_pLightTree = std::make_unique<LightTree>();
 
-	const float rx = px + 0.5f;
-	const float ry = py + 0.5f;
-	const float cx = (2.f * rx / static_cast<float>(m_Width) - 1.f) * aspectRatio * fov;
-	const float cy = (1.f - (2.f * ry) / static_cast<float>(m_Height)) * fov;
+	m_SampledLights.clear();
+	m_UnsampledLights.clear();
 
-	Vector3 viewRayDirection = { cx * Vector3::UnitX + cy * Vector3::UnitY + Vector3::UnitZ };
-	viewRayDirection.Normalize();
+	std::vector<Vector3> positions{};
+	std::vector<float> powers{};
+	std::vector<float> influenceRadiiSquared{};
 
-	const Vector3 cameraSpaceDirection = { cx, cy ,1 };
+	for (uint32_t lightIndex = 0; lightIndex < frame.lights.size(); ++lightIndex)
+	{
+		const Light& light = frame.lights[lightIndex];
+		if (light.type != LightType::Point)
+		{
+			m_UnsampledLights.push_back(lightIndex);
+			continue;
+		}
 
-	const Ray viewRay = Ray(cameraToOrigin, cameraToWWorld.TransformVector(cameraSpaceDirection));
+		m_SampledLights.push_back(lightIndex);
+		positions.push_back(light.origin);
+		powers.push_back(std::max({ light.color.r, light.color.g, light.color.b }) * light.intensity);
+		influenceRadiiSquared.push_back(m_LightRadiiSquared[lightIndex]);
+	}
 
-	const Vector3 v = viewRay.direction.Normalized() * (-1.0f);
+	m_pLightTree->Build(positions, powers, influenceRadiiSquared);
+	m_LightTreeHash = frame.lightsHash;
+	m_LightTreeCutoff = cutoff;
+}
 
-	HitRecord closestHit = {};
+void Renderer::RenderWavefront(const FrameSnapshot& frame, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t stride) const
+{
+	thread_local WavefrontQueues t_Queues{};
+	WavefrontQueues& queues = t_Queues;
 
-	ColorRGB finalColor = {};
+	GenerateCameraRays(frame, queues, x0, y0, x1, y1, stride);
+	TraceCameraRays(frame, queues);
+
+	if (ReprojectCameraRays(frame, queues))
+	{
+		SortShadingRequests(frame, queues);
+		GenerateShadowRays(frame, queues, GetTileLights(x0, y0));
+		TraceShadowRays(frame, queues);
+		AccumulateLighting(frame, queues);
+	}
 
-	pScene->GetClosestHit(viewRay, closestHit);
+	ResolveCameraRays(queues, stride);
+}
 
-	if (closestHit.didHit)
+void Renderer::GenerateCameraRays(const FrameSnapshot& frame, WavefrontQueues& queues, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t stride) const
+{
+	queues.ClearCameraRays();
+
+	//Packet by packet, so every packet is a contiguous range of the queue
+	const uint32_t packetSize = RayPacket::TileSize * stride;
+
+	for (uint32_t packetY0 = y0; packetY0 < y1; packetY0 += packetSize)
+	{
+		for (uint32_t packetX0 = x0; packetX0 < x1; packetX0 += packetSize)
+		{
+			WavefrontQueues::Packet packet{};
+			packet.x0 = packetX0;
+			packet.y0 = packetY0;
+			packet.x1 = std::min(packetX0 + packetSize, x1);
+			packet.y1 = std::min(packetY0 + packetSize, y1);
+			packet.firstRay = static_cast<uint32_t>(queues.pixelX.size());
+
+			for (uint32_t py = packet.y0; py < packet.y1; py += stride)
+			{
+				for (uint32_t px = packet.x0; px < packet.x1; px += stride)
+				{
+					const Vector3 direction = GetViewDirection(frame,
+						px + m_SampleOffsetX * std::min(stride, packet.x1 - px),
+						py + m_SampleOffsetY * std::min(stride, packet.y1 - py));
+
+					queues.pixelX.push_back(px);
+					queues.pixelY.push_back(py);
+					queues.directionX.push_back(direction.x);
+					queues.directionY.push_back(direction.y);
+					queues.directionZ.push_back(direction.z);
+				}
+			}
+
+			packet.rayCount = static_cast<uint32_t>(queues.pixelX.size()) - packet.firstRay;
+			queues.packets.push_back(packet);
+		}
+	}
+
+	const size_t rayCount = queues.pixelX.size();
+	queues.closestHits.assign(rayCount, HitRecord{});
+	queues.colors.assign(rayCount, ColorRGB{});
+	queues.isReused.assign(rayCount, 0);
+}
+
+void Renderer::TraceCameraRays(const FrameSnapshot& frame, WavefrontQueues& queues) const
+{
+	if (!m_PacketTracingEnabled)
+	{
+		for (uint32_t rayIndex = 0; rayIndex < queues.pixelX.size(); ++rayIndex)
+		{
+			frame.pScene->GetClosestHit(queues.GetCameraRay(frame.cameraOrigin, rayIndex), queues.closestHits[rayIndex]);
+		}
+		return;
+	}
+
+	for (const WavefrontQueues::Packet& queuedPacket : queues.packets)
+	{
+		RayPacket packet{};
+		packet.origin = frame.cameraOrigin;
+
+		for (uint32_t rayIndex = queuedPacket.firstRay; rayIndex < queuedPacket.firstRay + queuedPacket.rayCount; ++rayIndex)
+		{
+			packet.AddRay({ queues.directionX[rayIndex], queues.directionY[rayIndex], queues.directionZ[rayIndex] });
+		}
+
+		//Pixel corners rather than centers, so every ray is strictly inside the frustum
+		const Vector3 corners[4] =
+		{
+			GetViewDirection(frame, static_cast<float>(queuedPacket.x0), static_cast<float>(queuedPacket.y0)),
+			GetViewDirection(frame, static_cast<float>(queuedPacket.x1), static_cast<float>(queuedPacket.y0)),
+			GetViewDirection(frame, static_cast<float>(queuedPacket.x1), static_cast<float>(queuedPacket.y1)),
+			GetViewDirection(frame, static_cast<float>(queuedPacket.x0), static_cast<float>(queuedPacket.y1))
+		};
+		packet.Finalize(corners);
+
+		//Finalize pads the packet, so the scene writes past rayCount
+		HitRecord closestHits[RayPacket::MaxRayCount] = {};
+		frame.pScene->GetClosestHits(packet, closestHits);
+
+		std::copy_n(closestHits, queuedPacket.rayCount, queues.closestHits.begin() + queuedPacket.firstRay);
+	}
+}
+
+bool Renderer::ReprojectCameraRays(const FrameSnapshot& frame, WavefrontQueues& queues) const
+{
+	if (!m_pTemporalHistory || !m_pTemporalHistory->isActive)
+		return true;
+
+	const size_t rayCount = queues.pixelX.size();
+	queues.previousSamples.assign(rayCount, nullptr);
+
+	bool isShadingNeeded = false;
+
+	for (uint32_t rayIndex = 0; rayIndex < rayCount; ++rayIndex)
+	{
+		const TemporalSample*& pPrevious = queues.previousSamples[rayIndex];
+
+		if (ReprojectTemporalSample(frame, queues.pixelX[rayIndex], queues.pixelY[rayIndex], queues.closestHits[rayIndex], pPrevious))
+		{
+			queues.isReused[rayIndex] = 1;
+			queues.colors[rayIndex] = pPrevious->color;
+		}
+		else
+			isShadingNeeded = true;
+	}
+
+	return isShadingNeeded;
+}
+
+void Renderer::SortShadingRequests(const FrameSnapshot& frame, WavefrontQueues& queues) const
+{
+	const uint32_t rayCount = static_cast<uint32_t>(queues.pixelX.size());
+
+	const auto needsShading = [&](uint32_t rayIndex)
+		{
+			return queues.closestHits[rayIndex].didHit && !queues.isReused[rayIndex];
+		};
+
+	//Counting sort, materialCounts ends up holding where each material's requests end
+	std::vector<uint32_t>& materialCounts = queues.materialCounts;
+	materialCounts.assign(frame.materials.size() + 1, 0);
+
+	for (uint32_t rayIndex = 0; rayIndex < rayCount; ++rayIndex)
+	{
+		if (needsShading(rayIndex))
+			++materialCounts[queues.closestHits[rayIndex].materialIndex + 1];
+	}
+
+	for (size_t i = 1; i < materialCounts.size(); ++i)
+	{
+		materialCounts[i] += materialCounts[i - 1];
+	}
+
+	queues.shadingRays.resize(materialCounts.back());
+	queues.viewX.resize(rayCount);
+	queues.viewY.resize(rayCount);
+	queues.viewZ.resize(rayCount);
+
+	for (uint32_t rayIndex = 0; rayIndex < rayCount; ++rayIndex)
+	{
+		if (!needsShading(rayIndex))
+			continue;
+
+		queues.shadingRays[materialCounts[queues.closestHits[rayIndex].materialIndex]++] = rayIndex;
+
+		const Vector3 v = queues.GetCameraRay(frame.cameraOrigin, rayIndex).direction.Normalized() * (-1.0f);
+		queues.viewX[rayIndex] = v.x;
+		queues.viewY[rayIndex] = v.y;
+		queues.viewZ[rayIndex] = v.z;
+	}
+}
+
+void Renderer::GenerateShadowRays(const FrameSnapshot& frame, WavefrontQueues& queues, std::span<const uint32_t> lightIndices) const
+{
+	queues.ClearShadowRays();
+
+	//Lights behind the surface add nothing to these
+	const bool isFacingLightRequired = m_CurrentLightingMode == LightingMode::Combined || m_CurrentLightingMode == LightingMode::ObservedArea;
+
+	const std::vector<uint32_t>& shadingRays = queues.shadingRays;
+
+	//Light by light, so the requests of a light stay in sorted order and every pixel still adds its lights up in order
+	for (const uint32_t lightIndex : lightIndices)
 	{
-		for (const Light& light : lights)
+		const Light& light = frame.lights[lightIndex];
+
+		for (size_t requestIndex = 0; requestIndex < shadingRays.size();)
 		{
-			const Vector3 startingPoint = closestHit.origin + closestHit.normal * 0.001f;
-			const Vector3 directionHitToLight = light.origin - startingPoint;
+			WavefrontQueues::ShadowRun run{};
+			run.lightIndex = lightIndex;
+			run.materialIndex = queues.closestHits[shadingRays[requestIndex]].materialIndex;
+			run.firstRay = static_cast<uint32_t>(queues.shadowCameraRays.size());
+
+			for (; requestIndex < shadingRays.size() && queues.closestHits[shadingRays[requestIndex]].materialIndex == run.materialIndex; ++requestIndex)
+			{
+				const uint32_t rayIndex = shadingRays[requestIndex];
+				const HitRecord& closestHit = queues.closestHits[rayIndex];
+
+				if ((light.origin - closestHit.origin).SqrMagnitude() > m_LightRadiiSquared[lightIndex])
+					continue;
+
+				const Vector3 startingPoint = closestHit.origin + closestHit.normal * 0.001f;
+				const Vector3 directionHitToLight = light.origin - startingPoint;
+
+				const float distance = directionHitToLight.Magnitude();
+				const Vector3 direction = directionHitToLight.Normalized();
+
+				const float cosAngle = Vector3::Dot(closestHit.normal, direction);
+				if (isFacingLightRequired && cosAngle < 0)
+					continue;
 
-			const float distance = directionHitToLight.Magnitude();
+				const Vector3 l = (light.origin - closestHit.origin).Normalized();
 
-			const Vector3 l = (light.origin - closestHit.origin).Normalized();
+				queues.shadowCameraRays.push_back(rayIndex);
+				queues.shadowOriginX.push_back(startingPoint.x);
+				queues.shadowOriginY.push_back(startingPoint.y);
+				queues.shadowOriginZ.push_back(startingPoint.z);
+				queues.shadowDirectionX.push_back(direction.x);
+				queues.shadowDirectionY.push_back(direction.y);
+				queues.shadowDirectionZ.push_back(direction.z);
+				queues.shadowDistances.push_back(distance);
+				queues.cosAngles.push_back(cosAngle);
+				queues.lightDirectionX.push_back(l.x);
+				queues.lightDirectionY.push_back(l.y);
+				queues.lightDirectionZ.push_back(l.z);
+			}
+
+			run.endRay = static_cast<uint32_t>(queues.shadowCameraRays.size());
+			if (run.endRay > run.firstRay)
+				queues.shadowRuns.push_back(run);
+		}
+	}
+
+	queues.isOccluded.assign(queues.shadowCameraRays.size(), 0);
+}
+
+void Renderer::TraceShadowRays(const FrameSnapshot& frame, WavefrontQueues& queues) const
+{
+	if (!m_ShadowsEnabled)
+		return;
 
-			Ray lightRay
+	for (const WavefrontQueues::ShadowRun& run : queues.shadowRuns)
+	{
+		for (uint32_t rayIndex = run.firstRay; rayIndex < run.endRay; ++rayIndex)
+		{
+			const Ray lightRay
 			{
-				startingPoint,
-				directionHitToLight.Normalized(),
+				{ queues.shadowOriginX[rayIndex], queues.shadowOriginY[rayIndex], queues.shadowOriginZ[rayIndex] },
+				{ queues.shadowDirectionX[rayIndex], queues.shadowDirectionY[rayIndex], queues.shadowDirectionZ[rayIndex] },
 				0.0001f,
-				distance
+				queues.shadowDistances[rayIndex]
 			};
 
-			lightRay.max = distance;
+			queues.isOccluded[rayIndex] = frame.pScene->DoesHit(lightRay, run.lightIndex);
+		}
+	}
+}
+
+void Renderer::AccumulateLighting(const FrameSnapshot& frame, WavefrontQueues& queues) const
+{
+	std::vector<ColorRGB>& colors = queues.colors;
+
+	//Runs through the unoccluded shadow rays of every run, contribution(run, shadowRayIndex, rayIndex)
+	const auto forEachLitRay = [&](auto&& contribution)
+		{
+			for (const WavefrontQueues::ShadowRun& run : queues.shadowRuns)
+			{
+				for (uint32_t shadowRayIndex = run.firstRay; shadowRayIndex < run.endRay; ++shadowRayIndex)
+				{
+					if (queues.isOccluded[shadowRayIndex])
+						continue;
+
+					const uint32_t rayIndex = queues.shadowCameraRays[shadowRayIndex];
+					colors[rayIndex] += contribution(run, shadowRayIndex, rayIndex);
+				}
+			}
+		};
 
-			const float cosAngle = Vector3::Dot(closestHit.normal, lightRay.direction);
+	//One loop per material type, with isWeighted (the combined lighting mode) known at compile time too
+	const auto accumulateMaterialRun = [&](auto materialType, auto isWeighted, const WavefrontQueues::ShadowRun& run)
+		{
+			constexpr MaterialType type = decltype(materialType)::value;
+
+			const Light& light = frame.lights[run.lightIndex];
+			const Material& material = frame.materials[run.materialIndex];
 
-			if (m_ShadowsEnabled && pScene->DoesHit(lightRay)) continue;
+			const auto addLighting = [&](uint32_t shadowRayIndex, const ColorRGB& brdf)
+				{
+					const uint32_t rayIndex = queues.shadowCameraRays[shadowRayIndex];
 
-			switch (m_CurrentLightingMode)
+					if constexpr (decltype(isWeighted)::value)
+					{
+						const ColorRGB radiance = LightUtils::GetRadiance(light, queues.closestHits[rayIndex].origin);
+						colors[rayIndex] += radiance * brdf * queues.cosAngles[shadowRayIndex];
+					}
+					else
+						colors[rayIndex] += brdf;
+				};
+
+			//Solid colors and Lambert are constants per material, nothing to batch
+			if constexpr (type == MaterialType::LambertPhong || type == MaterialType::CookTorrence)
 			{
-			case LightingMode::ObservedArea:
+				if (m_BatchedShadingEnabled)
+				{
+					//The lit shadow rays of the run, 8 at a time. A last partial batch repeats its last lane
+					alignas(32) float normalX[Float8::Size], normalY[Float8::Size], normalZ[Float8::Size];
+					alignas(32) float lightX[Float8::Size], lightY[Float8::Size], lightZ[Float8::Size];
+					alignas(32) float viewX[Float8::Size], viewY[Float8::Size], viewZ[Float8::Size];
+					alignas(32) float brdfR[Float8::Size], brdfG[Float8::Size], brdfB[Float8::Size];
+					uint32_t shadowRayIndices[Float8::Size];
+					int laneCount = 0;
 
-				if (cosAngle < 0) continue;
+					const auto shadeBatch = [&]()
+						{
+							for (int lane = 0; lane < Float8::Size; ++lane)
+							{
+								const uint32_t shadowRayIndex = shadowRayIndices[std::min(lane, laneCount - 1)];
+								const uint32_t rayIndex = queues.shadowCameraRays[shadowRayIndex];
+								const Vector3& normal = queues.closestHits[rayIndex].normal;
 
-				finalColor += ColorRGB{ cosAngle, cosAngle, cosAngle };
+								normalX[lane] = normal.x;
+								normalY[lane] = normal.y;
+								normalZ[lane] = normal.z;
+								lightX[lane] = queues.lightDirectionX[shadowRayIndex];
+								lightY[lane] = queues.lightDirectionY[shadowRayIndex];
+								lightZ[lane] = queues.lightDirectionZ[shadowRayIndex];
+								viewX[lane] = queues.viewX[rayIndex];
+								viewY[lane] = queues.viewY[rayIndex];
+								viewZ[lane] = queues.viewZ[rayIndex];
+							}
 
-				break;
-			case LightingMode::Radiance:
+							ShadeMaterial8<type>(material,
+								Vector3x8::Load(normalX, normalY, normalZ),
+								Vector3x8::Load(lightX, lightY, lightZ),
+								Vector3x8::Load(viewX, viewY, viewZ)).Store(brdfR, brdfG, brdfB);
 
-				finalColor += LightUtils::GetRadiance(light, closestHit.origin);
+							for (int lane = 0; lane < laneCount; ++lane)
+							{
+								addLighting(shadowRayIndices[lane], { brdfR[lane], brdfG[lane], brdfB[lane] });
+							}
 
-				break;
-			case LightingMode::BRDF:
+							laneCount = 0;
+						};
 
-				finalColor += materials[closestHit.materialIndex]->Shade(closestHit, l, v);
+					for (uint32_t shadowRayIndex = run.firstRay; shadowRayIndex < run.endRay; ++shadowRayIndex)
+					{
+						if (queues.isOccluded[shadowRayIndex])
+							continue;
 
-				break;
-			case LightingMode::Combined:
+						shadowRayIndices[laneCount++] = shadowRayIndex;
+						if (laneCount == Float8::Size)
+							shadeBatch();
+					}
 
-				if (cosAngle < 0) continue;
+					if (laneCount > 0)
+						shadeBatch();
 
-				finalColor += (LightUtils::GetRadiance(light, closestHit.origin) *
-					materials[closestHit.materialIndex]->Shade(closestHit, l, v) *
-					cosAngle);
+					return;
+				}
+			}
 
-				break;
+			for (uint32_t shadowRayIndex = run.firstRay; shadowRayIndex < run.endRay; ++shadowRayIndex)
+			{
+				if (queues.isOccluded[shadowRayIndex])
+					continue;
+
+				const uint32_t rayIndex = queues.shadowCameraRays[shadowRayIndex];
+
+				const Vector3 l{ queues.lightDirectionX[shadowRayIndex], queues.lightDirectionY[shadowRayIndex], queues.lightDirectionZ[shadowRayIndex] };
+				const Vector3 v{ queues.viewX[rayIndex], queues.viewY[rayIndex], queues.viewZ[rayIndex] };
+
+				addLighting(shadowRayIndex, ShadeMaterial<type>(material, queues.closestHits[rayIndex], l, v));
 			}
+		};
+
+	const auto accumulateMaterialRuns = [&](auto isWeighted)
+		{
+			for (const WavefrontQueues::ShadowRun& run : queues.shadowRuns)
+			{
+				switch (frame.materials[run.materialIndex].type)
+				{
+				case MaterialType::SolidColor:
+					accumulateMaterialRun(std::integral_constant<MaterialType, MaterialType::SolidColor>{}, isWeighted, run);
+					break;
+				case MaterialType::Lambert:
+					accumulateMaterialRun(std::integral_constant<MaterialType, MaterialType::Lambert>{}, isWeighted, run);
+					break;
+				case MaterialType::LambertPhong:
+					accumulateMaterialRun(std::integral_constant<MaterialType, MaterialType::LambertPhong>{}, isWeighted, run);
+					break;
+				case MaterialType::CookTorrence:
+					accumulateMaterialRun(std::integral_constant<MaterialType, MaterialType::CookTorrence>{}, isWeighted, run);
+					break;
+				}
+			}
+		};
+
+	switch (m_CurrentLightingMode)
+	{
+	case LightingMode::ObservedArea:
+		forEachLitRay([&](const WavefrontQueues::ShadowRun&, uint32_t shadowRayIndex, uint32_t)
+			{
+				const float cosAngle = queues.cosAngles[shadowRayIndex];
+				return ColorRGB{ cosAngle, cosAngle, cosAngle };
+			});
+		break;
+	case LightingMode::Radiance:
+		forEachLitRay([&](const WavefrontQueues::ShadowRun& run, uint32_t, uint32_t rayIndex)
+			{
+				return LightUtils::GetRadiance(frame.lights[run.lightIndex], queues.closestHits[rayIndex].origin);
+			});
+		break;
+	case LightingMode::BRDF:
+		accumulateMaterialRuns(std::false_type{});
+		break;
+	case LightingMode::Combined:
+		accumulateMaterialRuns(std::true_type{});
+		break;
+	}
+}
+
+void Renderer::ResolveCameraRays(WavefrontQueues& queues, uint32_t stride) const
+{
+	const bool isTemporalActive = m_pTemporalHistory && m_pTemporalHistory->isActive;
+
+	for (uint32_t rayIndex = 0; rayIndex < queues.pixelX.size(); ++rayIndex)
+	{
+		const uint32_t px = queues.pixelX[rayIndex];
+		const uint32_t py = queues.pixelY[rayIndex];
+
+		ColorRGB color = queues.colors[rayIndex];
+		if (!queues.isReused[rayIndex])
+		{
+			color.MaxToOne();
+
+			if (isTemporalActive)
+				color = AccumulateTemporalSample(px, py, queues.previousSamples[rayIndex], color);
 		}
+
+		StorePixel(px, py, queues.closestHits[rayIndex], color);
+
+		if (stride > 1)
+			FillBlock(px, py, std::min(stride, static_cast<uint32_t>(m_Width) - px), std::min(stride, static_cast<uint32_t>(m_Height) - py));
 	}
+}
 
-	finalColor.MaxToOne();
+void Renderer::WritePixel(uint32_t px, uint32_t py, const ColorRGB& color) const
+{
+	m_pBufferPixels[px + (py * m_Width)] = FrameBuffer::PackPixel(
+		static_cast<uint8_t>(color.r * 255),
+		static_cast<uint8_t>(color.g * 255),
+		static_cast<uint8_t>(color.b * 255));
+}
+
+
+void Renderer::FillBlock(uint32_t px, uint32_t py, uint32_t blockWidth, uint32_t blockHeight) const
+{
+	const uint32_t color = m_pBufferPixels[px + (py * m_Width)];
+
+	for (uint32_t y = py; y < py + blockHeight; ++y)
+	{
+		std::fill_n(m_pBufferPixels + px + (y * m_Width), blockWidth, color);
+	}
+}
+
+bool Renderer::SaveBufferToImage(const std::string& filename) const
+{
+	return GetFrameBuffer().SaveToImage(filename);
+}
+
+float Renderer::GetLoadImbalance() const
+{
+	return m_pScheduler->GetLastFrameStats().GetImbalance();
+}
+
+void Renderer::ToggleProgressiveRendering()
+{
+	m_ProgressiveEnabled = !m_ProgressiveEnabled;
+	m_ProgressiveViewHash = 0;
+
+	std::cout << "Progressive rendering " << (m_ProgressiveEnabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::ToggleAntiAliasing()
+{
+	m_AntiAliasingEnabled = !m_AntiAliasingEnabled;
+
+	std::cout << "Adaptive anti-aliasing " << (m_AntiAliasingEnabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::CycleTemporalMode()
+{
+	int currentTemporalMode = static_cast<int>(m_CurrentTemporalMode);
+	++currentTemporalMode %= 3;
+	m_CurrentTemporalMode = TemporalMode{ currentTemporalMode };
+
+	constexpr const char* modeNames[] = { "OFF", "reuse", "reuse + TAA" };
+	std::cout << "Temporal reprojection " << modeNames[currentTemporalMode] << std::endl;
+}
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+void Renderer::ToggleDirtyRegions()
+{
+	m_DirtyRegionsEnabled = !m_DirtyRegionsEnabled;
+
+	std::cout << "Dirty region rendering " << (m_DirtyRegionsEnabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::ToggleWavefront()
+{
+	m_WavefrontEnabled = !m_WavefrontEnabled;
+
+	std::cout << "Wavefront rendering " << (m_WavefrontEnabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::ToggleBatchedShading()
+{
+	m_BatchedShadingEnabled = !m_BatchedShadingEnabled;
+
+	std::cout << "Batched SIMD shading " << (m_BatchedShadingEnabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::SetLightCutoff(float cutoff)
+{
+	m_LightCutoff = std::max(cutoff, 0.f);
 }
 
+void Renderer::ToggleLightSampling()
+{
+	m_LightSamplingEnabled = !m_LightSamplingEnabled;
+
+	std::cout << "Light tree sampling " << (m_LightSamplingEnabled ? "ON" : "OFF") << std::endl;
+}
 
-bool Renderer::SaveBufferToImage() const
+void Renderer::SetLightSampleCount(uint32_t count)
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	m_LightSampleCount = std::clamp(count, 1u, MaxLightSampleCount);
 }
 
 void Renderer::CycleLightingMode()
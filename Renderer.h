@@ -1,41 +1,120 @@
 #pragma once
 
 #include <cstdint>
-
-struct SDL_Window;
-struct SDL_Surface;
-
+#include <future>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
 
 namespace dae
 {
+	class FrameBuffer;
 	class Scene;
+	class TileScheduler;
+	struct FrameSnapshot;
+	struct LightTree;
+	struct Material;
 
-	struct Matrix;
 	struct Vector3;
+	struct ColorRGB;
+	struct Ray;
+	struct HitRecord;
 
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		//Renders into in-memory frame buffers of width x height, presenting them is up to the caller.
+		//threadCount 0 uses every hardware thread, tileSize is rounded up to a multiple of the packet size
+		Renderer(uint32_t width, uint32_t height, uint32_t threadCount = 0, uint32_t tileSize = 32);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix cameraToWWorld, const Vector3 cameraToOrigin) const;
-		bool SaveBufferToImage() const;
+		void Render(Scene* pScene);
+
+		//Pipelined frames: renders into the other of two frame buffers on another thread, while the caller presents the finished one
+		//and updates the next frame. Call SwapFrameBuffers once the returned future is ready
+		std::future<void> RenderAsync(Scene* pScene);
+		void SwapFrameBuffers();
+
+		//Last finished frame. Stays untouched by a running RenderAsync
+		const FrameBuffer& GetFrameBuffer() const;
+
+		//stride > 1 traces one ray per stride x stride block of pixels and fills the block with it (progressive rendering)
+		void RenderPixel(const FrameSnapshot& frame, uint32_t px, uint32_t py, uint32_t stride = 1) const;
+		void RenderTile(const FrameSnapshot& frame, uint32_t tileIndex, uint32_t stride = 1) const;
+		//Traces the primary rays of at most 8x8 samples as one packet, see RayPacket.h
+		void RenderPacket(const FrameSnapshot& frame, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t stride = 1) const;
+		//Renders only [x0, x1) x [y0, y1) of the frame into the finished frame buffer, one sample per pixel
+		//without the progressive, anti-aliasing, temporal or dirty region passes (distributed rendering, see Distributed.h)
+		void RenderRegion(Scene* pScene, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+		//Saves the last finished frame, returns false when that failed
+		bool SaveBufferToImage(const std::string& filename = "RayTracing_Buffer.bmp") const;
 
 		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; };
+		void TogglePacketTracing() { m_PacketTracingEnabled = !m_PacketTracingEnabled; };
+		void ToggleProgressiveRendering();
+		void ToggleAntiAliasing();
+		void CycleTemporalMode();
+		void ToggleDirtyRegions();
+		void ToggleWavefront();
+		void ToggleBatchedShading();
 		void CycleLightingMode();
 
+		//Point lights whose radiance (brightest channel) drops below cutoff are ignored from there on,
+		//and only lights that can reach a tile are considered for it. 0 keeps every light everywhere
+		void SetLightCutoff(float cutoff);
+		float GetLightCutoff() const { return m_LightCutoff; }
+		//Rather than every light, every hit shades GetLightSampleCount point lights picked from a light tree by importance
+		static constexpr uint32_t MaxLightSampleCount = 1u << 16;
+		void ToggleLightSampling();
+		//Clamped to [1, MaxLightSampleCount]
+		void SetLightSampleCount(uint32_t count);
+		uint32_t GetLightSampleCount() const { return m_LightSampleCount; }
+
+		//Load balance of the last Render, busiest thread relative to the average
+		float GetLoadImbalance() const;
+		//Primary rays traced by the last Render, per pixel
+		float GetSamplesPerPixel() const { return m_SamplesPerPixel; }
+		//Pixels of the last Render that reused their color from the previous frame, as a fraction
+		float GetReusedPixelRatio() const { return m_ReusedPixelRatio; }
+		//Tiles the last Render traced again, as a fraction
+		float GetDirtyTileRatio() const { return m_DirtyTileRatio; }
+		//Lights in the tile light lists of the last Render, as a fraction of every light in every tile
+		float GetTileLightRatio() const { return m_TileLightRatio; }
+
 	private:
-		SDL_Window* m_pWindow = {};
+		struct PixelSample;
+		struct FrameHistory;
+
+		//What the previous frame was rendered from, to find out what changed since
+		std::unique_ptr<FrameHistory> m_pFrameHistory;
 
-		SDL_Surface* m_pBuffer = {};
-		uint32_t* m_pBufferPixels = {};
+		void RenderFrame(Scene* pScene);
+		void BeginFrame(const FrameSnapshot& frame);
+		void EndFrame(const FrameSnapshot& frame, uint32_t stride);
+		uint64_t GetSettings() const; //Everything that changes how every pixel looks
+		void GetTileBounds(uint32_t tileIndex, uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1) const;
+		//World space direction through (rx, ry) in pixel coordinates
+		Vector3 GetViewDirection(const FrameSnapshot& frame, float rx, float ry) const;
+		//Lights only those of lightIndices, see GetTileLights
+		ColorRGB Shade(const FrameSnapshot& frame, std::span<const uint32_t> lightIndices, const Ray& viewRay, const HitRecord& closestHit) const;
+		//What one light adds to the hit in the current lighting mode, nothing when it is out of range, in shadow or behind the surface
+		ColorRGB ShadeLight(const FrameSnapshot& frame, const Material& material, uint32_t lightIndex, const Vector3& v, const HitRecord& closestHit) const;
+		void ShadePixel(const FrameSnapshot& frame, uint32_t px, uint32_t py, const Ray& viewRay, const HitRecord& closestHit) const;
+		//Writes the shaded color of pixel (px, py) and keeps what the next passes and frames need of it
+		void StorePixel(uint32_t px, uint32_t py, const HitRecord& closestHit, const ColorRGB& color) const;
+		void WritePixel(uint32_t px, uint32_t py, const ColorRGB& color) const;
+		//Copies pixel (px, py) over the rest of the block it is the top left corner of
+		void FillBlock(uint32_t px, uint32_t py, uint32_t blockWidth, uint32_t blockHeight) const;
+
+		std::unique_ptr<FrameBuffer> m_pFrameBuffers[2];
+		int m_FinishedBufferIndex = 0; //Render draws over it, RenderAsync into the other one
+		uint32_t* m_pBufferPixels = {}; //Render target
 
 		enum class LightingMode
 		{
@@ -51,6 +130,129 @@ namespace dae
 		int m_Width;
 		int m_Height;
 
+		std::unique_ptr<TileScheduler> m_pScheduler;
+		uint32_t m_TileSize;
+
 		bool m_ShadowsEnabled;
+		bool m_PacketTracingEnabled = true;
+
+		//Progressive rendering: 1/8th, 1/4th, 1/2 and then full resolution on consecutive frames,
+		//back to the coarsest pass as soon as the camera or the scene changes
+		static constexpr uint32_t CoarsestStride = 8;
+
+		bool m_ProgressiveEnabled = false;
+		uint32_t m_ProgressiveStride = 1; //Of the last frame
+		uint64_t m_ProgressiveViewHash = 0;
+
+		//Adaptive anti-aliasing: once every pixel has its first sample, pixels that hit another object or material than a neighbour,
+		//or differ too much in color from it, are resampled on a stratified AntiAliasingGrid x AntiAliasingGrid grid
+		static constexpr uint32_t AntiAliasingGrid = 3; //Odd, so the center stratum is the first sample
+		static constexpr float AntiAliasingContrast = 0.1f; //Per color channel
+
+		bool m_AntiAliasingEnabled = false;
+		bool m_CollectPixelSamples = false; //Anti-aliasing the current frame
+		std::unique_ptr<PixelSample[]> m_pPixelSamples;
+		float m_SamplesPerPixel = 1.f;
+
+		//Returns the number of pixels that were resampled
+		//restoreFirstSamples rewrites the pixels that no longer need refining, for tiles that were not rendered again
+		uint32_t RefineTile(const FrameSnapshot& frame, uint32_t tileIndex, bool restoreFirstSamples = false) const;
+		bool NeedsRefinement(uint32_t px, uint32_t py) const;
+
+		//Temporal reprojection: the hit and color of every pixel are kept for the next frame. A pixel whose hit lands on the same object,
+		//at the same depth and with the same normal in the previous frame, with nothing that moved in the way of the lights, reuses its color.
+		//With jittered TAA every pixel first accumulates TemporalSampleCount jittered samples, reprojected the same way
+		enum class TemporalMode
+		{
+			Off,
+			Reuse,
+			AntiAliasing
+		};
+
+		struct TemporalSample;
+		struct TemporalHistory;
+
+		static constexpr uint32_t TemporalSampleCount = 16;
+
+		TemporalMode m_CurrentTemporalMode = { TemporalMode::Off };
+		std::unique_ptr<TemporalHistory> m_pTemporalHistory;
+		float m_ReusedPixelRatio = 0.f;
+
+		//Where in the pixel the primary ray goes, jittered by TAA
+		float m_SampleOffsetX = 0.5f;
+		float m_SampleOffsetY = 0.5f;
+		uint32_t m_FrameIndex = 0;
+
+		void BeginTemporalFrame(uint32_t stride);
+		void EndTemporalFrame();
+		ColorRGB ShadeTemporal(const FrameSnapshot& frame, uint32_t px, uint32_t py, const Ray& viewRay, const HitRecord& closestHit) const;
+		//First half of ShadeTemporal: records the hit of pixel (px, py) and looks up its previous sample.
+		//Returns true when the pixel reuses the color of pPrevious, otherwise it is shaded and passed to AccumulateTemporalSample
+		bool ReprojectTemporalSample(const FrameSnapshot& frame, uint32_t px, uint32_t py, const HitRecord& closestHit, const TemporalSample*& pPrevious) const;
+		ColorRGB AccumulateTemporalSample(uint32_t px, uint32_t py, const TemporalSample* pPrevious, const ColorRGB& color) const;
+		//Sample of the previous frame the hit reprojects onto, nullptr when it fails one of the validation tests
+		const TemporalSample* FindHistorySample(const FrameSnapshot& frame, uint32_t px, uint32_t py, const HitRecord& closestHit) const;
+		bool IsAffectedByMovedObjects(const FrameSnapshot& frame, const Vector3& position) const;
+
+		//Dirty regions: with the camera standing still, only tiles that see something that moved, or a surface whose shadow rays
+		//cross something that moved, are rendered again. The others are copied from the previous frame
+		bool m_DirtyRegionsEnabled = true;
+		float m_DirtyTileRatio = 1.f;
+		std::vector<uint8_t> m_DirtyTiles{};
+
+		void MarkDirtyTiles(const FrameSnapshot& frame);
+		bool IsTileDirty(const FrameSnapshot& frame, uint32_t tileIndex) const;
+		void CopyTile(uint32_t tileIndex) const;
+
+		//Light culling: a point light contributes less than m_LightCutoff outside of its influence sphere. Every frame, each tile
+		//gets the lights whose sphere covers part of it on screen, and shading skips the ones whose sphere does not reach the hit.
+		//Only applies to the radiance and combined lighting modes, the others do not fall off with distance
+		float m_LightCutoff = 0.f;
+		float m_TileLightRatio = 1.f;
+		std::vector<float> m_LightRadiiSquared{}; //Per light, infinite for directional lights and without a cutoff in use
+		std::vector<uint32_t> m_TileLightOffsets{}; //Where the lights of every tile start in m_TileLightIndices, and one past the last tile
+		std::vector<uint32_t> m_TileLightIndices{}; //In increasing order per tile, so lights add up in the same order
+
+		//m_LightCutoff in the lighting modes it applies to, 0 in the others
+		float GetActiveLightCutoff() const;
+		void BuildTileLightLists(const FrameSnapshot& frame);
+		//Lights of the tile pixel (px, py) lies in
+		std::span<const uint32_t> GetTileLights(uint32_t px, uint32_t py) const;
+
+		//Light sampling: a LightTree over the point lights, built again whenever they change. Every hit adds m_LightSampleCount
+		//lights picked from it, each divided by its probability and the sample count, and every directional light.
+		//The tile light lists are not used, the tree never picks lights whose influence sphere cannot reach the hit
+		bool m_LightSamplingEnabled = false;
+		uint32_t m_LightSampleCount = 4;
+		uint32_t m_LightSamplingSeed = 0; //Changes every frame, so the lights a pixel picks do too
+		std::unique_ptr<LightTree> m_pLightTree;
+		uint64_t m_LightTreeHash = 0; //FrameSnapshot::lightsHash the tree was built for
+		float m_LightTreeCutoff = 0.f; //GetActiveLightCutoff the tree was built for
+		std::vector<uint32_t> m_SampledLights{}; //Scene light index of every light in the tree
+		std::vector<uint32_t> m_UnsampledLights{}; //Directional lights, shaded at every hit
+
+		void BuildLightTree(const FrameSnapshot& frame);
+		ColorRGB SampleLights(const FrameSnapshot& frame, const Material& material, const Vector3& v, const HitRecord& closestHit) const;
+
+		//Wavefront rendering: rather than tracing and shading sample by sample, every stage runs over all samples of a tile
+		//before the next one starts, on SoA queues: camera rays, closest hits, temporal reprojection, shading requests sorted
+		//by material, shadow rays, occlusion and accumulation. The lighting mode and material type are switched on once per run
+		struct WavefrontQueues;
+
+		bool m_WavefrontEnabled = false;
+		//Runs of Lambert-Phong and Cook-Torrence hits are shaded 8 (pixel, light) pairs at a time, see BRDF::Batched
+		bool m_BatchedShadingEnabled = true;
+
+		//Same samples as RenderTile with packets on [x0, x1) x [y0, y1)
+		void RenderWavefront(const FrameSnapshot& frame, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t stride) const;
+		void GenerateCameraRays(const FrameSnapshot& frame, WavefrontQueues& queues, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t stride) const;
+		void TraceCameraRays(const FrameSnapshot& frame, WavefrontQueues& queues) const;
+		//Resolves the samples that reuse their color, returns false when no sample is left to shade
+		bool ReprojectCameraRays(const FrameSnapshot& frame, WavefrontQueues& queues) const;
+		void SortShadingRequests(const FrameSnapshot& frame, WavefrontQueues& queues) const;
+		void GenerateShadowRays(const FrameSnapshot& frame, WavefrontQueues& queues, std::span<const uint32_t> lightIndices) const;
+		void TraceShadowRays(const FrameSnapshot& frame, WavefrontQueues& queues) const;
+		void AccumulateLighting(const FrameSnapshot& frame, WavefrontQueues& queues) const;
+		void ResolveCameraRays(WavefrontQueues& queues, uint32_t stride) const;
 	};
 }
@@ -1,13 +1,14 @@
 #include "Scene.h"
 #include "Utils.h"
-#include "Material.h"
+#include "RayPacket.h"
+#include "MeshCache.h"
 
 namespace dae {
 
 #pragma region Base Scene
 	
 	Scene::Scene() :
-		m_Materials({ new Material_SolidColor({1,0,0}) })
+		m_Materials({ Material::SolidColor({1,0,0}) })
 	{
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
@@ -15,79 +16,454 @@ namespace dae {
 		m_Lights.reserve(32);
 	}
 
-	Scene::~Scene()
+	Scene::~Scene() = default;
+
+	std::unique_ptr<Scene> Scene::Create(const std::string& name)
 	{
-		for (auto& pMaterial : m_Materials)
+		if (name == "reference")
+			return std::make_unique<Scene_W4_ReferenceScene>();
+		if (name == "bunny")
+			return std::make_unique<Scene_W4_BunnyScene>();
+		if (name == "lowpolyman")
+			return std::make_unique<Scene_LowpolyMan>();
+		if (name == "manylights")
+			return std::make_unique<Scene_ManyLights>();
+
+		return nullptr;
+	}
+
+	namespace
+	{
+		void SetSphereHit(const Sphere& sphere, uint32_t sphereIndex, const Ray& ray, float t, HitRecord& hitRecord)
 		{
-			delete pMaterial;
-			pMaterial = nullptr;
+			hitRecord.t = t;
+			hitRecord.origin = ray.origin + ray.direction * t;
+			hitRecord.normal = (hitRecord.origin - sphere.origin) / sphere.radius;
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = sphere.materialIndex;
+			hitRecord.objectId = HitRecord::SphereId | sphereIndex;
 		}
 
-		m_Materials.clear();
+		//FNV-1a, only used to tell whether anything changed between frames
+		void HashBytes(uint64_t& hash, const void* pData, size_t size)
+		{
+			const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+			for (size_t i = 0; i < size; ++i)
+			{
+				hash = (hash ^ pBytes[i]) * 0x100000001b3ull;
+			}
+		}
 	}
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
+		GetClosestPlaneHit(ray, closestHit);
 
-		HitRecord hitRecord = {};
-		for (const Sphere& sphere : m_SphereGeometries)
-		{
-			GeometryUtils::HitTest_Sphere(sphere, ray, hitRecord);
-			//choosing the closest intersection point to camera
-			if (hitRecord.t < closestHit.t)
+		float maxDistance = std::min(ray.max, closestHit.t);
+		float distances[SphereBlock::Size];
+
+		uint32_t closestSphere = UINT32_MAX;
+		GeometryUtils::TraverseBVH4(m_SphereBVH4.nodes, ray, maxDistance, [&](uint32_t blockIndex, uint32_t)
+			{
+				const SphereBlock& block = m_SphereBlocks[blockIndex];
+
+				uint32_t hitMask = GeometryUtils::IntersectSphereBlock(block, ray, maxDistance, distances);
+				while (hitMask)
+				{
+					const int lane = std::countr_zero(hitMask);
+					hitMask &= hitMask - 1;
+
+					if (distances[lane] < maxDistance)
+					{
+						maxDistance = distances[lane];
+						closestSphere = block.sphereIndex[lane];
+					}
+				}
+				return false;
+			});
+
+		if (closestSphere != UINT32_MAX)
+			SetSphereHit(m_SphereGeometries[closestSphere], closestSphere, ray, maxDistance, closestHit);
+
+		GeometryUtils::TraverseBVH(m_TopLevelBVH, ray, maxDistance, [&](uint32_t meshIndex)
 			{
-				closestHit = hitRecord;
+				//Only closer hits are written to closestHit
+				Ray clippedRay = ray;
+				clippedRay.max = maxDistance;
+
+				if (GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[meshIndex], clippedRay, closestHit))
+				{
+					maxDistance = std::min(maxDistance, closestHit.t);
+					closestHit.objectId = HitRecord::TriangleMeshId | meshIndex;
+				}
+
+				return false;
+			});
+	}
 
-			}
+	void Scene::GetClosestHits(const RayPacket& packet, HitRecord* closestHits) const
+	{
+		//Planes are unbounded, nothing to share between the rays
+		for (uint32_t i = 0; i < packet.rayCount; ++i)
+		{
+			GetClosestPlaneHit(packet.GetRay(i), closestHits[i]);
 		}
-		for (const Plane& plane : m_PlaneGeometries)
-		{	
-			GeometryUtils::HitTest_Plane(plane, ray, hitRecord);
-			//choosing the closest intersection point to camera
-			if (hitRecord.t < closestHit.t)
+
+		alignas(16) float maxDistances[RayPacket::MaxRayCount];
+		for (uint32_t i = 0; i < packet.rayCount; ++i)
+		{
+			maxDistances[i] = closestHits[i].t;
+		}
+
+		float packetMaxDistance = GeometryUtils::GetMaxDistance(maxDistances, packet.rayCount);
+
+		GeometryUtils::TraverseBVH4(m_SphereBVH4.nodes, packet, packetMaxDistance, [&](const BVH4Node& node, uint32_t slot)
+			{
+				const Vector3 leafMin = GeometryUtils::GetLeafMin(node, slot);
+				const Vector3 leafMax = GeometryUtils::GetLeafMax(node, slot);
+				const SphereBlock& block = m_SphereBlocks[node.child[slot]];
+
+				for (uint32_t first = 0; first < packet.rayCount; first += 4)
+				{
+					uint32_t rayMask = GeometryUtils::SlabTestPacket_AABB(packet, first, leafMin, leafMax, maxDistances);
+					while (rayMask)
+					{
+						const uint32_t rayIndex = first + std::countr_zero(rayMask);
+						rayMask &= rayMask - 1;
+
+						const Ray ray = packet.GetRay(rayIndex);
+
+						float distances[SphereBlock::Size];
+						uint32_t hitMask = GeometryUtils::IntersectSphereBlock(block, ray, maxDistances[rayIndex], distances);
+						while (hitMask)
+						{
+							const int lane = std::countr_zero(hitMask);
+							hitMask &= hitMask - 1;
+
+							if (distances[lane] < maxDistances[rayIndex])
+							{
+								maxDistances[rayIndex] = distances[lane];
+								SetSphereHit(m_SphereGeometries[block.sphereIndex[lane]], block.sphereIndex[lane], ray, distances[lane], closestHits[rayIndex]);
+							}
+						}
+					}
+				}
+
+				packetMaxDistance = GeometryUtils::GetMaxDistance(maxDistances, packet.rayCount);
+				return false;
+			});
+
+		GeometryUtils::TraverseBVH(m_TopLevelBVH, packet, packetMaxDistance, [&](uint32_t meshIndex)
 			{
-				closestHit = hitRecord;
+				GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[meshIndex], packet, closestHits);
+
+				for (uint32_t i = 0; i < packet.rayCount; ++i)
+				{
+					//Only closer hits are written
+					if (closestHits[i].t < maxDistances[i])
+						closestHits[i].objectId = HitRecord::TriangleMeshId | meshIndex;
+
+					maxDistances[i] = closestHits[i].t;
+				}
+
+				packetMaxDistance = GeometryUtils::GetMaxDistance(maxDistances, packet.rayCount);
+				return false;
+			});
+	}
+
+	void Scene::GetClosestPlaneHit(const Ray& ray, HitRecord& closestHit) const
+	{
+		float maxDistance = std::min(ray.max, closestHit.t);
+		float distances[PlaneBlock::Size];
+
+		uint32_t closestPlane = UINT32_MAX;
+		for (uint32_t blockIndex = 0; blockIndex < m_PlaneBlocks.size(); ++blockIndex)
+		{
+			uint32_t hitMask = GeometryUtils::IntersectPlaneBlock(m_PlaneBlocks[blockIndex], ray, maxDistance, distances);
+			while (hitMask)
+			{
+				const int lane = std::countr_zero(hitMask);
+				hitMask &= hitMask - 1;
+
+				//choosing the closest intersection point to camera
+				if (distances[lane] < maxDistance)
+				{
+					maxDistance = distances[lane];
+					closestPlane = blockIndex * PlaneBlock::Size + lane;
+				}
 			}
 		}
-		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+
+		if (closestPlane == UINT32_MAX)
+			return;
+
+		const Plane& plane = m_PlaneGeometries[closestPlane];
+
+		closestHit.t = maxDistance;
+		closestHit.origin = ray.origin + ray.direction * maxDistance;
+		closestHit.normal = plane.normal;
+		closestHit.didHit = true;
+		closestHit.materialIndex = plane.materialIndex;
+		closestHit.objectId = HitRecord::PlaneId | closestPlane;
+	}
+
+	enum class OccluderType : uint8_t
+	{
+		None,
+		Plane,
+		Sphere,
+		TriangleMesh
+	};
+
+	struct OccluderCacheEntry
+	{
+		OccluderType type = OccluderType::None;
+		uint32_t objectIndex = 0;
+		uint32_t triangleIndex = 0;
+	};
+
+	namespace
+	{
+		//Last occluder per light, per render thread. Only ever a hint: it is re-tested before being trusted
+		thread_local std::vector<OccluderCacheEntry> t_OccluderCache{};
+	}
+
+	bool Scene::DoesHit(const Ray& ray) const
+	{
+		return FindOccluder(ray, nullptr);
+	}
+
+	bool Scene::DoesHit(const Ray& ray, uint32_t lightIndex) const
+	{
+		if (lightIndex >= t_OccluderCache.size())
+			t_OccluderCache.resize(lightIndex + 1);
+
+		OccluderCacheEntry& cachedOccluder = t_OccluderCache[lightIndex];
+
+		if (IsOccludedBy(cachedOccluder, ray))
+			return true;
+
+		return FindOccluder(ray, &cachedOccluder);
+	}
+
+	bool Scene::FindOccluder(const Ray& ray, OccluderCacheEntry* pOccluder) const
+	{
+		float distances[SphereBlock::Size];
+
+		for (uint32_t blockIndex = 0; blockIndex < m_PlaneBlocks.size(); ++blockIndex)
 		{
-			GeometryUtils::HitTest_TriangleMesh(mesh, ray, hitRecord);
-			//choosing the closest intersection point to camera
-			if (hitRecord.t < closestHit.t)
+			const uint32_t hitMask = GeometryUtils::IntersectPlaneBlock(m_PlaneBlocks[blockIndex], ray, ray.max, distances);
+			if (hitMask)
 			{
-				closestHit = hitRecord;
+				if (pOccluder)
+					*pOccluder = { OccluderType::Plane, blockIndex * PlaneBlock::Size + std::countr_zero(hitMask) };
+				return true;
 			}
-
 		}
+
+		bool didHit = false;
+
+		GeometryUtils::TraverseBVH4(m_SphereBVH4.nodes, ray, ray.max, [&](uint32_t blockIndex, uint32_t)
+			{
+				const SphereBlock& block = m_SphereBlocks[blockIndex];
+
+				const uint32_t hitMask = GeometryUtils::IntersectSphereBlock(block, ray, ray.max, distances);
+				if (hitMask == 0)
+					return false;
+
+				if (pOccluder)
+					*pOccluder = { OccluderType::Sphere, block.sphereIndex[std::countr_zero(hitMask)] };
+
+				didHit = true;
+				return true;
+			});
+
+		if (didHit)
+			return true;
+
+		GeometryUtils::TraverseBVH(m_TopLevelBVH, ray, ray.max, [&](uint32_t meshIndex)
+			{
+				uint32_t triangleIndex = 0;
+
+				didHit = GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[meshIndex], ray, &triangleIndex);
+
+				if (didHit && pOccluder)
+					*pOccluder = { OccluderType::TriangleMesh, meshIndex, triangleIndex };
+
+				return didHit;
+			});
+
+		return didHit;
 	}
 
-	bool Scene::DoesHit(const Ray& ray) const
+	bool Scene::IsOccludedBy(const OccluderCacheEntry& occluder, const Ray& ray) const
 	{
-		for (const Sphere& sphere : m_SphereGeometries)
+		//Indices are validated, the cache may still hold entries from another scene
+		switch (occluder.type)
 		{
-			HitRecord hit = {};
+		case OccluderType::Plane:
+			return occluder.objectIndex < m_PlaneGeometries.size() &&
+				GeometryUtils::HitTest_Plane(m_PlaneGeometries[occluder.objectIndex], ray);
+		case OccluderType::Sphere:
+			return occluder.objectIndex < m_SphereGeometries.size() &&
+				GeometryUtils::HitTest_Sphere(m_SphereGeometries[occluder.objectIndex], ray);
+		case OccluderType::TriangleMesh:
+			return occluder.objectIndex < m_TriangleMeshGeometries.size() &&
+				GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[occluder.objectIndex], occluder.triangleIndex, ray);
+		default:
+			return false;
+		}
+	}
+
+	FrameSnapshot Scene::TakeSnapshot(float aspectRatio) const
+	{
+		//Copy, CalculateCameraToWorld updates the camera axes
+		Camera camera = m_Camera;
+
+		FrameSnapshot snapshot{};
+		snapshot.pScene = this;
+		snapshot.lights = m_Lights;
+		snapshot.materials = m_Materials;
+		snapshot.cameraOrigin = camera.origin;
+		snapshot.cameraToWorld = camera.CalculateCameraToWorld();
+		snapshot.fov = tanf(TO_RADIANS * camera.fovAngle / 2.f);
+		snapshot.aspectRatio = aspectRatio;
+
+		snapshot.viewHash = m_ContentHash;
+		HashBytes(snapshot.viewHash, &camera.origin, sizeof(camera.origin));
+		HashBytes(snapshot.viewHash, &camera.forward, sizeof(camera.forward));
+		HashBytes(snapshot.viewHash, &camera.fovAngle, sizeof(camera.fovAngle));
+
+		snapshot.objects = m_ObjectStates;
+		snapshot.lightsHash = m_LightsHash;
+
+		return snapshot;
+	}
+
+	void Scene::UpdateAccelerationStructure()
+	{
+		UpdatePlaneBlocks();
+		UpdateSphereBVH();
 
-			if (GeometryUtils::HitTest_Sphere(sphere, ray, hit)) return true;
+		m_MeshBounds.clear();
+		m_MeshBounds.reserve(m_TriangleMeshGeometries.size());
 
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			m_MeshBounds.push_back({ mesh.transformedMinAABB, mesh.transformedMaxAABB });
 		}
 
+		//Objects only move between frames, refitting keeps the cost per frame linear
+		if (!m_TopLevelBVH.IsEmpty() && m_TopLevelBVH.GetPrimCount() == m_MeshBounds.size())
+			m_TopLevelBVH.Refit(m_MeshBounds);
+		else
+			m_TopLevelBVH.Build(m_MeshBounds);
+
+		UpdateObjectStates();
+	}
+
+	void Scene::UpdateObjectStates()
+	{
+		constexpr uint64_t hashSeed = 0xcbf29ce484222325ull;
+
+		m_ObjectStates.clear();
+		m_ObjectStates.reserve(m_PlaneGeometries.size() + m_SphereGeometries.size() + m_TriangleMeshGeometries.size());
+
 		for (const Plane& plane : m_PlaneGeometries)
 		{
-			HitRecord hit = {};
+			//Unbounded
+			SceneObjectState& state = m_ObjectStates.emplace_back(SceneObjectState{ AABB{ { -FLT_MAX, -FLT_MAX, -FLT_MAX }, { FLT_MAX, FLT_MAX, FLT_MAX } }, hashSeed });
+			HashBytes(state.hash, &plane.origin, sizeof(plane.origin));
+			HashBytes(state.hash, &plane.normal, sizeof(plane.normal));
+		}
+		for (size_t i = 0; i < m_SphereGeometries.size(); ++i)
+		{
+			const Sphere& sphere = m_SphereGeometries[i];
 
-			if (GeometryUtils::HitTest_Plane(plane, ray, hit)) return true;
+			SceneObjectState& state = m_ObjectStates.emplace_back(SceneObjectState{ m_SphereBounds[i], hashSeed });
+			HashBytes(state.hash, &sphere.origin, sizeof(sphere.origin));
+			HashBytes(state.hash, &sphere.radius, sizeof(sphere.radius));
+		}
+		for (size_t i = 0; i < m_TriangleMeshGeometries.size(); ++i)
+		{
+			const TriangleMesh& mesh = m_TriangleMeshGeometries[i];
 
+			SceneObjectState& state = m_ObjectStates.emplace_back(SceneObjectState{ m_MeshBounds[i], hashSeed });
+			HashBytes(state.hash, &mesh.worldTransform, sizeof(mesh.worldTransform));
 		}
 
-		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		m_LightsHash = hashSeed;
+		HashBytes(m_LightsHash, m_Lights.data(), m_Lights.size() * sizeof(Light));
+
+		m_ContentHash = m_LightsHash;
+		for (const SceneObjectState& state : m_ObjectStates)
 		{
-			HitRecord hit = {};
+			HashBytes(m_ContentHash, &state.hash, sizeof(state.hash));
+		}
+	}
 
-			if (GeometryUtils::HitTest_TriangleMesh(mesh, ray, hit, true)) return true;
+	void Scene::UpdatePlaneBlocks()
+	{
+		const uint32_t planeCount = static_cast<uint32_t>(m_PlaneGeometries.size());
+		m_PlaneBlocks.assign((planeCount + PlaneBlock::Size - 1) / PlaneBlock::Size, PlaneBlock{});
+
+		for (uint32_t planeIndex = 0; planeIndex < planeCount; ++planeIndex)
+		{
+			const Plane& plane = m_PlaneGeometries[planeIndex];
+
+			PlaneBlock& block = m_PlaneBlocks[planeIndex / PlaneBlock::Size];
+			const uint32_t lane = planeIndex % PlaneBlock::Size;
+
+			block.originX[lane] = plane.origin.x;
+			block.originY[lane] = plane.origin.y;
+			block.originZ[lane] = plane.origin.z;
+			block.normalX[lane] = plane.normal.x;
+			block.normalY[lane] = plane.normal.y;
+			block.normalZ[lane] = plane.normal.z;
 		}
+	}
 
+	void Scene::UpdateSphereBVH()
+	{
+		m_SphereBounds.clear();
+		m_SphereBounds.reserve(m_SphereGeometries.size());
 
-		return false;
+		for (const Sphere& sphere : m_SphereGeometries)
+		{
+			const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+			m_SphereBounds.push_back({ sphere.origin - extent, sphere.origin + extent });
+		}
+
+		if (!m_SphereBVH.IsEmpty() && m_SphereBVH.GetPrimCount() == m_SphereBounds.size())
+			m_SphereBVH.Refit(m_SphereBounds);
+		else
+			m_SphereBVH.Build(m_SphereBounds);
+
+		//The leaves are remapped to the blocks, so the wide BVH is collapsed again every time
+		m_SphereBVH4.Collapse(m_SphereBVH);
+		m_SphereBlocks.clear();
+
+		m_SphereBVH4.RemapLeaves([this](uint32_t first, uint32_t count)
+			{
+				assert(count <= SphereBlock::Size && "Leaves must fit in one block");
+
+				SphereBlock& block = m_SphereBlocks.emplace_back(SphereBlock{});
+				std::fill(std::begin(block.radiusSquared), std::end(block.radiusSquared), -FLT_MAX);
+
+				for (uint32_t lane = 0; lane < count; ++lane)
+				{
+					const uint32_t sphereIndex = m_SphereBVH.primIndices[first + lane];
+					const Sphere& sphere = m_SphereGeometries[sphereIndex];
+
+					block.originX[lane] = sphere.origin.x;
+					block.originY[lane] = sphere.origin.y;
+					block.originZ[lane] = sphere.origin.z;
+					block.radiusSquared[lane] = sphere.radius * sphere.radius;
+					block.sphereIndex[lane] = sphereIndex;
+				}
+
+				return static_cast<uint32_t>(m_SphereBlocks.size() - 1);
+			});
 	}
 
 #pragma region Scene Helpers
@@ -147,9 +523,9 @@ namespace dae {
 		return &m_Lights.back();
 	}
 
-	unsigned char Scene::AddMaterial(Material* pMaterial)
+	unsigned char Scene::AddMaterial(const Material& material)
 	{
-		m_Materials.push_back(pMaterial);
+		m_Materials.push_back(material);
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
 
@@ -161,15 +537,15 @@ namespace dae {
 		m_Camera.origin = { 0,3,-9 };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::Lambert(colors::White, 1.f));
 
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
 		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
@@ -229,15 +605,15 @@ namespace dae {
 		m_Camera.origin = { 0,3,-9 };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::Lambert(colors::White, 1.f));
 
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
 		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
@@ -246,11 +622,7 @@ namespace dae {
 		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
 
 		m_pBunnyMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_bunny2.obj",
-
-			m_pBunnyMesh->positions,
-			m_pBunnyMesh->normals,
-			m_pBunnyMesh->indices);
+		MeshCache::LoadOBJ("Resources/lowpoly_bunny2.obj", *m_pBunnyMesh);
 
 		m_pBunnyMesh->Scale({ 2.f,2.f,2.f });
 		m_pBunnyMesh->UpdateAABB();
@@ -276,15 +648,15 @@ namespace dae {
 		m_Camera.origin = { 0,3,-9 };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::Lambert(colors::White, 1.f));
 
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
 		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
@@ -293,11 +665,7 @@ namespace dae {
 		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
 
 		m_pLowpolyMan = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_man.obj",
-
-			m_pLowpolyMan->positions,
-			m_pLowpolyMan->normals,
-			m_pLowpolyMan->indices);
+		MeshCache::LoadOBJ("Resources/lowpoly_man.obj", *m_pLowpolyMan);
 
 		m_pLowpolyMan->Scale({ 2.f,2.f,2.f });
 		m_pLowpolyMan->UpdateAABB();
@@ -316,6 +684,52 @@ namespace dae {
 		m_pLowpolyMan->UpdateTransforms();
 	}
 #pragma endregion
+#pragma region SCENE Raytracer_MANYLIGHTS
+	void Scene_ManyLights::Initialize()
+	{
+		sceneName = "Many Lights Scene";
+		m_Camera.origin = { 0,3,-9 };
+		m_Camera.fovAngle = 45.f;
+
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+
+		const auto matLambert_GrayBlue = AddMaterial(Material::Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
+		AddPlane(Vector3{ 0.f, 10.f, 0.f }, Vector3{ 0.f, -1.f, 0.f }, matLambert_GrayBlue); //TOP
+		AddPlane(Vector3{ 5.f, 0.f, 0.f }, Vector3{ -1.f, 0.f, 0.f }, matLambert_GrayBlue); //RIGHT
+		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
+
+		//4 x 3 spheres on the floor
+		const unsigned char sphereMaterials[4]{ matCT_GrayRoughMetal, matCT_GrayMediumMetal, matCT_GrayRoughPlastic, matCT_GrayMediumPlastic };
+		for (int z = 0; z < 3; ++z)
+		{
+			for (int x = 0; x < 4; ++x)
+			{
+				AddSphere(Vector3{ -3.f + x * 2.f, .5f, z * 3.f }, .5f, sphereMaterials[(x + z) % 4]);
+			}
+		}
+
+		//16 x 16 weak lights just above the floor, in between the spheres
+		for (int z = 0; z < 16; ++z)
+		{
+			for (int x = 0; x < 16; ++x)
+			{
+				const ColorRGB color
+				{
+					.5f + .5f * (x / 15.f),
+					.6f,
+					.5f + .5f * (z / 15.f)
+				};
+				AddPointLight(Vector3{ -4.5f + x * .6f, .3f, -2.f + z * .7f }, .15f, color);
+			}
+		}
+	}
+#pragma endregion
 }
 
 
@@ -1,19 +1,54 @@
 #pragma once
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "Material.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
 	struct Plane;
 	struct Sphere;
 	struct Light;
+	struct OccluderCacheEntry;
+	struct RayPacket;
+	class Scene;
+
+	//Where an object is, and a hash over everything that places it. Compared between frames to find what moved
+	struct SceneObjectState
+	{
+		AABB bounds{};
+		uint64_t hash = 0;
+	};
+
+	/**
+	 * \brief Everything a frame reads from the scene, taken once before rendering.
+	 * The spans point into the scene, which must not be updated until the frame is done,
+	 * so render threads share it without copying or allocating anything per pixel.
+	 */
+	struct FrameSnapshot
+	{
+		const Scene* pScene = nullptr; //Geometry and acceleration structures
+
+		std::span<const Light> lights = {};
+		std::span<const Material> materials = {};
+
+		Vector3 cameraOrigin = {};
+		Matrix cameraToWorld = {};
+		float fov = 1.f; //tan of half the field of view
+		float aspectRatio = 1.f;
+
+		uint64_t viewHash = 0; //Changes whenever the camera or anything in the scene moves
+
+		std::span<const SceneObjectState> objects = {}; //Planes, then spheres, then meshes
+		uint64_t lightsHash = 0;
+	};
 
 	//Scene Base Class
 	class Scene
@@ -27,6 +62,9 @@ namespace dae
 		Scene& operator=(const Scene&) = delete;
 		Scene& operator=(Scene&&) noexcept = delete;
 
+		//By the name used on the command line: reference, bunny, lowpolyman or manylights. nullptr for anything else
+		static std::unique_ptr<Scene> Create(const std::string& name);
+
 		virtual void Initialize() = 0;
 		virtual void Update(dae::Timer* pTimer)
 		{
@@ -35,12 +73,21 @@ namespace dae
 
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+		//closestHits holds one record per ray of the packet
+		void GetClosestHits(const RayPacket& packet, HitRecord* closestHits) const;
 		bool DoesHit(const Ray& ray) const;
+		//Shadow ray towards lights[lightIndex]: the last occluder this thread found for that light is tested first
+		bool DoesHit(const Ray& ray, uint32_t lightIndex) const;
+
+		FrameSnapshot TakeSnapshot(float aspectRatio) const;
+
+		//Refits (or rebuilds, when objects were added) the BVHs and refreshes the SoA copies of spheres and planes, call after Update
+		void UpdateAccelerationStructure();
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const std::vector<Material>& GetMaterials() const { return m_Materials; }
 
 	protected:
 		std::string	sceneName;
@@ -49,18 +96,43 @@ namespace dae
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
 		std::vector<Light> m_Lights{};
-		std::vector<Material*> m_Materials{};
+		std::vector<Material> m_Materials{};
+
+		//SoA copies of the spheres and planes, tested 8 at a time. Synced in UpdateAccelerationStructure.
+		//Spheres get their own BVH whose leaves point at a SphereBlock, planes are unbounded and always tested
+		BVH m_SphereBVH{};
+		BVH4 m_SphereBVH4{};
+		std::vector<SphereBlock> m_SphereBlocks{};
+		std::vector<AABB> m_SphereBounds{};
+		std::vector<PlaneBlock> m_PlaneBlocks{};
 
+		//Top-level BVH over the meshes
+		BVH m_TopLevelBVH{};
+		std::vector<AABB> m_MeshBounds{};
 
 		Camera m_Camera{};
 
+		//Synced in UpdateAccelerationStructure
+		std::vector<SceneObjectState> m_ObjectStates{};
+		uint64_t m_LightsHash = 0;
+		uint64_t m_ContentHash = 0; //Over all of the above
+
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
 
+		void GetClosestPlaneHit(const Ray& ray, HitRecord& closestHit) const;
+
+		void UpdatePlaneBlocks();
+		void UpdateSphereBVH();
+		void UpdateObjectStates();
+
+		bool FindOccluder(const Ray& ray, OccluderCacheEntry* pOccluder) const;
+		bool IsOccludedBy(const OccluderCacheEntry& occluder, const Ray& ray) const;
+
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
-		unsigned char AddMaterial(Material* pMaterial);
+		unsigned char AddMaterial(const Material& material);
 	};
 
 	class Scene_W4_ReferenceScene final : public Scene
@@ -111,4 +183,18 @@ namespace dae
 	private:
 		TriangleMesh* m_pLowpolyMan = nullptr;
 	};
+	//Reference room lit by a grid of weak point lights that each only reach a small part of it, for light culling
+	class Scene_ManyLights final : public Scene
+	{
+	public:
+		Scene_ManyLights() = default;
+		~Scene_ManyLights() override = default;
+
+		Scene_ManyLights(const Scene_ManyLights&) = delete;
+		Scene_ManyLights(Scene_ManyLights&&) noexcept = delete;
+		Scene_ManyLights& operator=(const Scene_ManyLights&) = delete;
+		Scene_ManyLights& operator=(Scene_ManyLights&&) noexcept = delete;
+
+		void Initialize() override;
+	};
 }
@@ -0,0 +1,173 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace dae;
+
+TileScheduler::TileScheduler(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	m_Workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		m_Workers.push_back(std::make_unique<Worker>());
+	}
+
+	//Worker 0 is whoever calls Run
+	m_Threads.reserve(threadCount - 1);
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		m_Threads.emplace_back(&TileScheduler::WorkerLoop, this, i);
+	}
+}
+
+TileScheduler::~TileScheduler()
+{
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_IsShuttingDown = true;
+	}
+	m_WorkAvailable.notify_all();
+
+	for (std::thread& thread : m_Threads)
+	{
+		thread.join();
+	}
+}
+
+void TileScheduler::Run(uint32_t taskCount, const std::function<void(uint32_t)>& task)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	const uint32_t workerCount = GetThreadCount();
+
+	//Contiguous ranges keep neighbouring tiles (and their cache lines) on one thread
+	for (uint32_t i = 0; i < workerCount; ++i)
+	{
+		Worker& worker = *m_Workers[i];
+
+		const uint32_t first = static_cast<uint32_t>(uint64_t{ taskCount } * i / workerCount);
+		const uint32_t last = static_cast<uint32_t>(uint64_t{ taskCount } * (i + 1) / workerCount);
+
+		std::lock_guard lock{ worker.mutex };
+		worker.tasks.clear();
+		for (uint32_t t = first; t < last; ++t)
+		{
+			worker.tasks.push_back(t);
+		}
+
+		worker.busyTime = 0.f;
+		worker.stolenTasks = 0;
+	}
+
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_pTask = &task;
+		m_BusyWorkers = workerCount - 1;
+		++m_Generation;
+	}
+	m_WorkAvailable.notify_all();
+
+	Execute(0);
+
+	{
+		std::unique_lock lock{ m_Mutex };
+		m_WorkDone.wait(lock, [this] { return m_BusyWorkers == 0; });
+		m_pTask = nullptr;
+	}
+
+	FrameStats stats{};
+	for (const std::unique_ptr<Worker>& pWorker : m_Workers)
+	{
+		stats.maxBusyTime = std::max(stats.maxBusyTime, pWorker->busyTime);
+		stats.averageBusyTime += pWorker->busyTime;
+		stats.stolenTasks += pWorker->stolenTasks;
+	}
+	stats.averageBusyTime /= static_cast<float>(workerCount);
+
+	const std::chrono::duration<float, std::milli> frameTime = std::chrono::high_resolution_clock::now() - startTime;
+	stats.frameTime = frameTime.count();
+
+	m_LastFrameStats = stats;
+}
+
+void TileScheduler::WorkerLoop(uint32_t workerIndex)
+{
+	uint64_t lastGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock lock{ m_Mutex };
+			m_WorkAvailable.wait(lock, [&] { return m_IsShuttingDown || m_Generation != lastGeneration; });
+
+			if (m_IsShuttingDown)
+				return;
+
+			lastGeneration = m_Generation;
+		}
+
+		Execute(workerIndex);
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			--m_BusyWorkers;
+		}
+		m_WorkDone.notify_one();
+	}
+}
+
+void TileScheduler::Execute(uint32_t workerIndex)
+{
+	Worker& worker = *m_Workers[workerIndex];
+
+	uint32_t task;
+	while (PopTask(workerIndex, task) || StealTask(workerIndex, task))
+	{
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		(*m_pTask)(task);
+
+		const std::chrono::duration<float, std::milli> taskTime = std::chrono::high_resolution_clock::now() - startTime;
+		worker.busyTime += taskTime.count();
+	}
+}
+
+bool TileScheduler::PopTask(uint32_t workerIndex, uint32_t& task)
+{
+	Worker& worker = *m_Workers[workerIndex];
+
+	std::lock_guard lock{ worker.mutex };
+	if (worker.tasks.empty())
+		return false;
+
+	task = worker.tasks.front();
+	worker.tasks.pop_front();
+	return true;
+}
+
+bool TileScheduler::StealTask(uint32_t thiefIndex, uint32_t& task)
+{
+	const uint32_t workerCount = GetThreadCount();
+
+	//Steal from the back, furthest away from where the owner is working
+	for (uint32_t offset = 1; offset < workerCount; ++offset)
+	{
+		Worker& victim = *m_Workers[(thiefIndex + offset) % workerCount];
+
+		std::lock_guard lock{ victim.mutex };
+		if (victim.tasks.empty())
+			continue;
+
+		task = victim.tasks.back();
+		victim.tasks.pop_back();
+
+		++m_Workers[thiefIndex]->stolenTasks;
+		return true;
+	}
+
+	return false;
+}
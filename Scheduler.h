@@ -0,0 +1,82 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	/**
+	 * \brief Persistent pool of worker threads running a batch of indexed tasks (screen tiles) per frame.
+	 * Every worker starts on its own contiguous range of tasks, so neighbouring tiles stay on one thread,
+	 * and steals from the back of another worker's deque once its own runs dry.
+	 * The calling thread takes part as worker 0.
+	 */
+	class TileScheduler final
+	{
+	public:
+		struct FrameStats
+		{
+			float frameTime = 0.f; //ms, wall clock time of Run
+			float maxBusyTime = 0.f; //ms, of the busiest worker
+			float averageBusyTime = 0.f; //ms
+			uint32_t stolenTasks = 0;
+
+			//Busiest worker relative to the average, 1 means perfectly balanced
+			float GetImbalance() const { return averageBusyTime > 0.f ? maxBusyTime / averageBusyTime : 1.f; }
+		};
+
+		//0 uses one thread per hardware thread
+		explicit TileScheduler(uint32_t threadCount = 0);
+		~TileScheduler();
+
+		TileScheduler(const TileScheduler&) = delete;
+		TileScheduler(TileScheduler&&) noexcept = delete;
+		TileScheduler& operator=(const TileScheduler&) = delete;
+		TileScheduler& operator=(TileScheduler&&) noexcept = delete;
+
+		//Runs task(i) for every i in [0, taskCount) and returns once all of them are done
+		void Run(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+		const FrameStats& GetLastFrameStats() const { return m_LastFrameStats; }
+
+	private:
+		struct Worker
+		{
+			std::mutex mutex{};
+			std::deque<uint32_t> tasks{};
+
+			float busyTime = 0.f;
+			uint32_t stolenTasks = 0;
+		};
+
+		std::vector<std::unique_ptr<Worker>> m_Workers{};
+		std::vector<std::thread> m_Threads{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WorkAvailable{};
+		std::condition_variable m_WorkDone{};
+
+		uint64_t m_Generation = 0; //Bumped for every Run, wakes the workers
+		uint32_t m_BusyWorkers = 0;
+		bool m_IsShuttingDown = false;
+
+		const std::function<void(uint32_t)>* m_pTask = nullptr;
+
+		FrameStats m_LastFrameStats{};
+
+		void WorkerLoop(uint32_t workerIndex);
+		void Execute(uint32_t workerIndex);
+
+		bool PopTask(uint32_t workerIndex, uint32_t& task);
+		bool StealTask(uint32_t thiefIndex, uint32_t& task);
+	};
+}
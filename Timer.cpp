@@ -1,23 +1,41 @@
 #include "Timer.h"
 
+#include <algorithm>
 #include <iostream>
 #include <numeric>
 
 #include <iostream>
 #include <fstream>
+#include <cfloat>
+#include <chrono>
 
-#include "SDL.h"
 using namespace dae;
 
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	uint64_t GetPerformanceCounter()
+	{
+		return static_cast<uint64_t>(Clock::now().time_since_epoch().count());
+	}
+}
+
 Timer::Timer()
 {
-	const uint64_t countsPerSecond = SDL_GetPerformanceFrequency();
-	m_SecondsPerCount = 1.0f / static_cast<float>(countsPerSecond);
+	const double countsPerSecond = static_cast<double>(Clock::period::den) / Clock::period::num;
+	m_SecondsPerCount = static_cast<float>(1.0 / countsPerSecond);
+}
+
+void Timer::SetFixedTimeStep(float seconds)
+{
+	m_FixedTimeStep = std::max(seconds, 0.f);
+	m_FixedTotalTime = 0.f;
 }
 
 void Timer::Reset()
 {
-	const uint64_t currentTime = SDL_GetPerformanceCounter();
+	const uint64_t currentTime = GetPerformanceCounter();
 
 	m_BaseTime = currentTime;
 	m_PreviousTime = currentTime;
@@ -29,7 +47,7 @@ void Timer::Reset()
 
 void Timer::Start()
 {
-	const uint64_t startTime = SDL_GetPerformanceCounter();
+	const uint64_t startTime = GetPerformanceCounter();
 
 	if (m_IsStopped)
 	{
@@ -61,9 +79,21 @@ void Timer::StartBenchmark(int numFrames)
 	m_Benchmarks.clear();
 	m_Benchmarks.resize(m_BenchmarkFrames);
 
+	m_BenchmarkSamplesPerPixel = 0.f;
+	m_BenchmarkSampledFrames = 0;
+
 	std::cout << "**BENCHMARK STARTED**\n";
 }
 
+void Timer::AddBenchmarkSamplesPerPixel(float samplesPerPixel)
+{
+	if (!m_BenchmarkActive)
+		return;
+
+	m_BenchmarkSamplesPerPixel += samplesPerPixel;
+	++m_BenchmarkSampledFrames;
+}
+
 void Timer::Update()
 {
 	if (m_IsStopped)
@@ -74,7 +104,7 @@ void Timer::Update()
 		return;
 	}
 
-	const uint64_t currentTime = SDL_GetPerformanceCounter();
+	const uint64_t currentTime = GetPerformanceCounter();
 	m_CurrentTime = currentTime;
 
 	m_ElapsedTime = (float)((m_CurrentTime - m_PreviousTime) * m_SecondsPerCount);
@@ -90,8 +120,17 @@ void Timer::Update()
 
 	m_TotalTime = (float)(((m_CurrentTime - m_PausedTime) - m_BaseTime) * m_SecondsPerCount);
 
+	//Simulated time only, FPS and benchmarks keep following the wall clock
+	const float wallElapsedTime = m_ElapsedTime;
+	if (m_FixedTimeStep > 0.f)
+	{
+		m_ElapsedTime = m_FixedTimeStep;
+		m_FixedTotalTime += m_FixedTimeStep;
+		m_TotalTime = m_FixedTotalTime;
+	}
+
 	//FPS LOGIC
-	m_FPSTimer += m_ElapsedTime;
+	m_FPSTimer += wallElapsedTime;
 	++m_FPSCount;
 	if (m_FPSTimer >= 1.0f)
 	{
@@ -119,12 +158,16 @@ void Timer::Update()
 				std::cout << ">> LOW = " << m_BenchmarkLow << std::endl;
 				std::cout << ">> AVG = " << m_BenchmarkAvg << std::endl;
 
+				const float averageSamplesPerPixel = m_BenchmarkSampledFrames > 0 ? m_BenchmarkSamplesPerPixel / float(m_BenchmarkSampledFrames) : 0.f;
+				std::cout << ">> SPP = " << averageSamplesPerPixel << std::endl;
+
 				//file save
 				std::ofstream fileStream("benchmark.txt");
 				fileStream << "FRAMES = " << m_BenchmarkCurrFrame << std::endl;
 				fileStream << "HIGH = " << m_BenchmarkHigh << std::endl;
 				fileStream << "LOW = " << m_BenchmarkLow << std::endl;
 				fileStream << "AVG = " << m_BenchmarkAvg << std::endl;
+				fileStream << "SPP = " << averageSamplesPerPixel << std::endl;
 				fileStream.close();
 			}
 		}
@@ -135,7 +178,7 @@ void Timer::Stop()
 {
 	if (!m_IsStopped)
 	{
-		const uint64_t currentTime = SDL_GetPerformanceCounter();
+		const uint64_t currentTime = GetPerformanceCounter();
 
 		m_StopTime = currentTime;
 		m_IsStopped = true;
@@ -18,12 +18,17 @@ namespace dae
 		Timer& operator=(Timer&&) noexcept = delete;
 
 		void StartBenchmark(int numFrames = 10);
+		//Averaged over a running benchmark and reported with it, call once per frame
+		void AddBenchmarkSamplesPerPixel(float samplesPerPixel);
 
 		void Reset();
 		void Start();
 		void Update();
 		void Stop();
 
+		//Every Update advances elapsed and total time by exactly this much, for reproducible offline renders. 0 follows the wall clock
+		void SetFixedTimeStep(float seconds);
+
 		uint32_t GetFPS() const { return m_FPS; };
 		float GetdFPS() const { return m_dFPS; };
 		float GetElapsed() const { return m_ElapsedTime; };
@@ -50,6 +55,9 @@ namespace dae
 		bool m_IsStopped = true;
 		bool m_ForceElapsedUpperBound = false;
 
+		float m_FixedTimeStep = 0.f;
+		float m_FixedTotalTime = 0.f;
+
 		bool m_BenchmarkActive = false;
 		float m_BenchmarkHigh = 0.f;
 		float m_BenchmarkLow = 0.f;
@@ -57,5 +65,7 @@ namespace dae
 		int m_BenchmarkFrames = 0;
 		int m_BenchmarkCurrFrame = 0;
 		std::vector<float> m_Benchmarks {};
+		float m_BenchmarkSamplesPerPixel = 0.f; //Sum
+		int m_BenchmarkSampledFrames = 0;
 	};
 }
\ No newline at end of file
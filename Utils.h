@@ -4,6 +4,9 @@
 #include "Math.h"
 #include "DataTypes.h"
 #include <iostream>
+#include <bit>
+#include <cstdlib>
+#include <immintrin.h>
 
 namespace dae
 {
@@ -49,13 +52,114 @@ namespace dae
 
 			return false;
 		}
+		//Occlusion only (shadow rays): same root selection, no hit record
 		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray)
 		{
-			HitRecord temp = {};
+			const Vector3 oc = ray.origin - sphere.origin;
 
-			return HitTest_Sphere(sphere, ray, temp, true);
+			const float a = Vector3::Dot(ray.direction, ray.direction);
+			const float b = Vector3::Dot(oc, ray.direction);
+			const float c = Vector3::Dot(oc, oc) - sphere.radius * sphere.radius;
+			const float discriminant = b * b - a * c;
+
+			if (discriminant <= 0)
+				return false;
+
+			const float sqrtD = sqrtf(discriminant);
+
+			float t = (-b - sqrtD) / a;
+			if (t < ray.min)
+			{
+				t = (-b + sqrtD) / a;
+			}
+
+			return t < ray.max && t > ray.min;
 		}
 
+		//Tests one ray against all 8 spheres of a block, with the same root selection as HitTest_Sphere.
+		//Returns a bit per lane that was hit closer than maxDistance, distances receives t for every lane
+#if defined(__AVX2__)
+		inline uint32_t IntersectSphereBlock(const SphereBlock& block, const Ray& ray, float maxDistance, float* distances)
+		{
+			const __m256 dx = _mm256_set1_ps(ray.direction.x);
+			const __m256 dy = _mm256_set1_ps(ray.direction.y);
+			const __m256 dz = _mm256_set1_ps(ray.direction.z);
+
+			const __m256 ocx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(block.originX));
+			const __m256 ocy = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(block.originY));
+			const __m256 ocz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(block.originZ));
+
+			const __m256 a = _mm256_set1_ps(Vector3::Dot(ray.direction, ray.direction));
+			const __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+			const __m256 c = _mm256_sub_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)),
+				_mm256_load_ps(block.radiusSquared));
+			const __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+
+			__m256 mask = _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GT_OQ);
+
+			const __m256 sqrtD = _mm256_sqrt_ps(_mm256_max_ps(discriminant, _mm256_setzero_ps()));
+			const __m256 minusB = _mm256_sub_ps(_mm256_setzero_ps(), b);
+			const __m256 tMin = _mm256_set1_ps(ray.min);
+
+			//Near root, or the far one when the near root is behind ray.min
+			const __m256 tNear = _mm256_div_ps(_mm256_sub_ps(minusB, sqrtD), a);
+			const __m256 tFar = _mm256_div_ps(_mm256_add_ps(minusB, sqrtD), a);
+			const __m256 t = _mm256_blendv_ps(tNear, tFar, _mm256_cmp_ps(tNear, tMin, _CMP_LT_OQ));
+
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, tMin, _CMP_GT_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(std::min(ray.max, maxDistance)), _CMP_LT_OQ));
+
+			_mm256_storeu_ps(distances, t);
+			return static_cast<uint32_t>(_mm256_movemask_ps(mask));
+		}
+#else
+		//SSE fallback, the block is tested as two halves of 4 lanes
+		inline uint32_t IntersectSphereBlock(const SphereBlock& block, const Ray& ray, float maxDistance, float* distances)
+		{
+			const __m128 dx = _mm_set1_ps(ray.direction.x);
+			const __m128 dy = _mm_set1_ps(ray.direction.y);
+			const __m128 dz = _mm_set1_ps(ray.direction.z);
+
+			const __m128 a = _mm_set1_ps(Vector3::Dot(ray.direction, ray.direction));
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 tMin = _mm_set1_ps(ray.min);
+			const __m128 tMax = _mm_set1_ps(std::min(ray.max, maxDistance));
+
+			uint32_t hitMask = 0;
+
+			for (uint32_t offset = 0; offset < SphereBlock::Size; offset += 4)
+			{
+				const __m128 ocx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(block.originX + offset));
+				const __m128 ocy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(block.originY + offset));
+				const __m128 ocz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(block.originZ + offset));
+
+				const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+				const __m128 c = _mm_sub_ps(
+					_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+					_mm_load_ps(block.radiusSquared + offset));
+				const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+
+				__m128 mask = _mm_cmpgt_ps(discriminant, zero);
+
+				const __m128 sqrtD = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+				const __m128 minusB = _mm_sub_ps(zero, b);
+
+				//Near root, or the far one when the near root is behind ray.min
+				const __m128 tNear = _mm_div_ps(_mm_sub_ps(minusB, sqrtD), a);
+				const __m128 tFar = _mm_div_ps(_mm_add_ps(minusB, sqrtD), a);
+				const __m128 useFar = _mm_cmplt_ps(tNear, tMin);
+				const __m128 t = _mm_or_ps(_mm_and_ps(useFar, tFar), _mm_andnot_ps(useFar, tNear));
+
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, tMin), _mm_cmplt_ps(t, tMax)));
+
+				_mm_storeu_ps(distances + offset, t);
+				hitMask |= static_cast<uint32_t>(_mm_movemask_ps(mask)) << offset;
+			}
+
+			return hitMask;
+		}
+#endif
 
 #pragma endregion
 #pragma region Plane HitTest
@@ -84,16 +188,95 @@ namespace dae
 			return false;
 		}
 
+		//Occlusion only (shadow rays)
 		inline bool HitTest_Plane(const Plane& plane, const Ray& ray)
 		{
-			HitRecord temp {};
-			return HitTest_Plane(plane, ray, temp, true);
+			const float dotPlaneRay = Vector3::Dot(plane.normal, ray.direction);
+
+			if (std::abs(dotPlaneRay) < 1e-6)
+				return false;
+
+			const float t = Vector3::Dot(plane.normal, (plane.origin - ray.origin)) / dotPlaneRay;
+
+			return t >= ray.min && t < ray.max;
+		}
+
+		//Tests one ray against all 8 planes of a block, with the same parallel threshold as HitTest_Plane.
+		//Returns a bit per lane that was hit closer than maxDistance, distances receives t for every lane
+#if defined(__AVX2__)
+		inline uint32_t IntersectPlaneBlock(const PlaneBlock& block, const Ray& ray, float maxDistance, float* distances)
+		{
+			const __m256 nx = _mm256_load_ps(block.normalX);
+			const __m256 ny = _mm256_load_ps(block.normalY);
+			const __m256 nz = _mm256_load_ps(block.normalZ);
+
+			const __m256 dotPlaneRay = _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(nx, _mm256_set1_ps(ray.direction.x)),
+				_mm256_mul_ps(ny, _mm256_set1_ps(ray.direction.y))),
+				_mm256_mul_ps(nz, _mm256_set1_ps(ray.direction.z)));
+
+			//|dot| >= 1e-6, clearing the sign bit gives the absolute value
+			const __m256 absDot = _mm256_andnot_ps(_mm256_set1_ps(-0.f), dotPlaneRay);
+			__m256 mask = _mm256_cmp_ps(absDot, _mm256_set1_ps(1e-6f), _CMP_GE_OQ);
+
+			const __m256 px = _mm256_sub_ps(_mm256_load_ps(block.originX), _mm256_set1_ps(ray.origin.x));
+			const __m256 py = _mm256_sub_ps(_mm256_load_ps(block.originY), _mm256_set1_ps(ray.origin.y));
+			const __m256 pz = _mm256_sub_ps(_mm256_load_ps(block.originZ), _mm256_set1_ps(ray.origin.z));
+
+			const __m256 t = _mm256_div_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, px), _mm256_mul_ps(ny, py)), _mm256_mul_ps(nz, pz)),
+				dotPlaneRay);
+
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(ray.min), _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(std::min(ray.max, maxDistance)), _CMP_LT_OQ));
+
+			_mm256_storeu_ps(distances, t);
+			return static_cast<uint32_t>(_mm256_movemask_ps(mask));
 		}
+#else
+		//SSE fallback, the block is tested as two halves of 4 lanes
+		inline uint32_t IntersectPlaneBlock(const PlaneBlock& block, const Ray& ray, float maxDistance, float* distances)
+		{
+			const __m128 dx = _mm_set1_ps(ray.direction.x);
+			const __m128 dy = _mm_set1_ps(ray.direction.y);
+			const __m128 dz = _mm_set1_ps(ray.direction.z);
+
+			const __m128 signBit = _mm_set1_ps(-0.f);
+			const __m128 epsilon = _mm_set1_ps(1e-6f);
+			const __m128 tMin = _mm_set1_ps(ray.min);
+			const __m128 tMax = _mm_set1_ps(std::min(ray.max, maxDistance));
+
+			uint32_t hitMask = 0;
+
+			for (uint32_t offset = 0; offset < PlaneBlock::Size; offset += 4)
+			{
+				const __m128 nx = _mm_load_ps(block.normalX + offset);
+				const __m128 ny = _mm_load_ps(block.normalY + offset);
+				const __m128 nz = _mm_load_ps(block.normalZ + offset);
+
+				const __m128 dotPlaneRay = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, dx), _mm_mul_ps(ny, dy)), _mm_mul_ps(nz, dz));
+				__m128 mask = _mm_cmpge_ps(_mm_andnot_ps(signBit, dotPlaneRay), epsilon);
+
+				const __m128 px = _mm_sub_ps(_mm_load_ps(block.originX + offset), _mm_set1_ps(ray.origin.x));
+				const __m128 py = _mm_sub_ps(_mm_load_ps(block.originY + offset), _mm_set1_ps(ray.origin.y));
+				const __m128 pz = _mm_sub_ps(_mm_load_ps(block.originZ + offset), _mm_set1_ps(ray.origin.z));
+
+				const __m128 t = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_mul_ps(nz, pz)), dotPlaneRay);
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, tMin), _mm_cmplt_ps(t, tMax)));
+
+				_mm_storeu_ps(distances + offset, t);
+				hitMask |= static_cast<uint32_t>(_mm_movemask_ps(mask)) << offset;
+			}
+
+			return hitMask;
+		}
+#endif
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
 
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Distance along the ray in t, culling is flipped for shadow rays
+		inline bool IntersectTriangle(const Triangle& triangle, const Ray& ray, bool isShadowRay, float& t)
 		{
 			const float dot = Vector3::Dot(triangle.normal, ray.direction);
 
@@ -102,7 +285,7 @@ namespace dae
 				return false;
 			}
 
-			if (ignoreHitRecord) {
+			if (isShadowRay) {
 				// For shadow rays
 				if (triangle.cullMode == TriangleCullMode::FrontFaceCulling)
 				{
@@ -127,7 +310,7 @@ namespace dae
 
 			const Vector3 L = triangle.v0 - ray.origin;
 
-			const float t = Vector3::Dot(L, triangle.normal) / Vector3::Dot(ray.direction, triangle.normal);
+			t = Vector3::Dot(L, triangle.normal) / Vector3::Dot(ray.direction, triangle.normal);
 
 			if (t < ray.min || t > ray.max)
 			{
@@ -150,6 +333,17 @@ namespace dae
 			p = intersectionPoint - triangle.v2;
 			if (Vector3::Dot(Vector3::Cross(e, p), triangle.normal) < 0) return false;
 
+			return true;
+		}
+
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float t;
+			if (!IntersectTriangle(triangle, ray, ignoreHitRecord, t))
+			{
+				return false;
+			}
+
 			if (!ignoreHitRecord)
 			{
 				hitRecord.t = t;
@@ -164,9 +358,145 @@ namespace dae
 
 		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray)
 		{
-			HitRecord temp = {};
-			return HitTest_Triangle(triangle, ray, temp, true);
+			float t;
+			return IntersectTriangle(triangle, ray, true, t);
+		}
+
+		//Moller-Trumbore against all 8 triangles of a block, culls like IntersectTriangle does for regular rays.
+		//Returns a bit per lane that was hit closer than maxDistance, distances receives t for every lane
+#if defined(__AVX2__)
+		inline uint32_t IntersectTriangleBlock(const TriangleBlock& block, const Ray& ray, TriangleCullMode cullMode, float maxDistance, float* distances)
+		{
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.f);
+
+			const __m256 dx = _mm256_set1_ps(ray.direction.x);
+			const __m256 dy = _mm256_set1_ps(ray.direction.y);
+			const __m256 dz = _mm256_set1_ps(ray.direction.z);
+
+			const __m256 dot = _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_load_ps(block.normalX), dx),
+				_mm256_mul_ps(_mm256_load_ps(block.normalY), dy)),
+				_mm256_mul_ps(_mm256_load_ps(block.normalZ), dz));
+
+			__m256 mask = _mm256_cmp_ps(dot, zero, _CMP_NEQ_OQ);
+			if (cullMode == TriangleCullMode::BackFaceCulling)
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(dot, zero, _CMP_LE_OQ));
+			else if (cullMode == TriangleCullMode::FrontFaceCulling)
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(dot, zero, _CMP_GE_OQ));
+
+			const __m256 e1x = _mm256_load_ps(block.edge1X);
+			const __m256 e1y = _mm256_load_ps(block.edge1Y);
+			const __m256 e1z = _mm256_load_ps(block.edge1Z);
+			const __m256 e2x = _mm256_load_ps(block.edge2X);
+			const __m256 e2y = _mm256_load_ps(block.edge2Y);
+			const __m256 e2z = _mm256_load_ps(block.edge2Z);
+
+			//p = d x e2
+			const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+			const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+			const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+
+			const __m256 determinant = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(determinant, zero, _CMP_NEQ_OQ));
+			const __m256 invDeterminant = _mm256_div_ps(one, determinant);
+
+			const __m256 sx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(block.v0X));
+			const __m256 sy = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(block.v0Y));
+			const __m256 sz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(block.v0Z));
+
+			const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), invDeterminant);
+			mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+
+			//q = s x e1
+			const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+			const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+			const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+
+			const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDeterminant);
+			mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+
+			const __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDeterminant);
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(ray.min), _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(std::min(ray.max, maxDistance)), _CMP_LE_OQ));
+
+			_mm256_storeu_ps(distances, t);
+			return static_cast<uint32_t>(_mm256_movemask_ps(mask));
 		}
+#else
+		//SSE fallback, the block is tested as two halves of 4 lanes
+		inline uint32_t IntersectTriangleBlock(const TriangleBlock& block, const Ray& ray, TriangleCullMode cullMode, float maxDistance, float* distances)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.f);
+
+			const __m128 dx = _mm_set1_ps(ray.direction.x);
+			const __m128 dy = _mm_set1_ps(ray.direction.y);
+			const __m128 dz = _mm_set1_ps(ray.direction.z);
+
+			const __m128 ox = _mm_set1_ps(ray.origin.x);
+			const __m128 oy = _mm_set1_ps(ray.origin.y);
+			const __m128 oz = _mm_set1_ps(ray.origin.z);
+
+			const __m128 tMin = _mm_set1_ps(ray.min);
+			const __m128 tMax = _mm_set1_ps(std::min(ray.max, maxDistance));
+
+			uint32_t hitMask = 0;
+
+			for (uint32_t offset = 0; offset < TriangleBlock::Size; offset += 4)
+			{
+				const __m128 dot = _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_load_ps(block.normalX + offset), dx),
+					_mm_mul_ps(_mm_load_ps(block.normalY + offset), dy)),
+					_mm_mul_ps(_mm_load_ps(block.normalZ + offset), dz));
+
+				__m128 mask = _mm_cmpneq_ps(dot, zero);
+				if (cullMode == TriangleCullMode::BackFaceCulling)
+					mask = _mm_and_ps(mask, _mm_cmple_ps(dot, zero));
+				else if (cullMode == TriangleCullMode::FrontFaceCulling)
+					mask = _mm_and_ps(mask, _mm_cmpge_ps(dot, zero));
+
+				const __m128 e1x = _mm_load_ps(block.edge1X + offset);
+				const __m128 e1y = _mm_load_ps(block.edge1Y + offset);
+				const __m128 e1z = _mm_load_ps(block.edge1Z + offset);
+				const __m128 e2x = _mm_load_ps(block.edge2X + offset);
+				const __m128 e2y = _mm_load_ps(block.edge2Y + offset);
+				const __m128 e2z = _mm_load_ps(block.edge2Z + offset);
+
+				//p = d x e2
+				const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+				const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+				const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+				const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+				mask = _mm_and_ps(mask, _mm_cmpneq_ps(determinant, zero));
+				const __m128 invDeterminant = _mm_div_ps(one, determinant);
+
+				const __m128 sx = _mm_sub_ps(ox, _mm_load_ps(block.v0X + offset));
+				const __m128 sy = _mm_sub_ps(oy, _mm_load_ps(block.v0Y + offset));
+				const __m128 sz = _mm_sub_ps(oz, _mm_load_ps(block.v0Z + offset));
+
+				const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDeterminant);
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+				//q = s x e1
+				const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+				const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+				const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+				const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDeterminant);
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+				const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDeterminant);
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, tMin), _mm_cmple_ps(t, tMax)));
+
+				_mm_storeu_ps(distances + offset, t);
+				hitMask |= static_cast<uint32_t>(_mm_movemask_ps(mask)) << offset;
+			}
+
+			return hitMask;
+		}
+#endif
 #pragma endregion
 #pragma region TriangeMesh HitTest
 		inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
@@ -191,50 +521,329 @@ namespace dae
 			return tmax > 0 && tmax >= tmin;
 		}
 
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Returns the distance at which the ray enters the box, or FLT_MAX when it misses it (or enters beyond maxDistance)
+		inline float SlabTest_AABB(const Vector3& aabbMin, const Vector3& aabbMax, const Ray& ray, const Vector3& invDirection, float maxDistance)
 		{
-			if (!SlabTest_TriangleMesh(mesh, ray))
+			const float tx1 = (aabbMin.x - ray.origin.x) * invDirection.x;
+			const float tx2 = (aabbMax.x - ray.origin.x) * invDirection.x;
+
+			float tmin = std::min(tx1, tx2);
+			float tmax = std::max(tx1, tx2);
+
+			const float ty1 = (aabbMin.y - ray.origin.y) * invDirection.y;
+			const float ty2 = (aabbMax.y - ray.origin.y) * invDirection.y;
+
+			tmin = std::max(tmin, std::min(ty1, ty2));
+			tmax = std::min(tmax, std::max(ty1, ty2));
+
+			const float tz1 = (aabbMin.z - ray.origin.z) * invDirection.z;
+			const float tz2 = (aabbMax.z - ray.origin.z) * invDirection.z;
+
+			tmin = std::max(tmin, std::min(tz1, tz2));
+			tmax = std::min(tmax, std::max(tz1, tz2));
+
+			if (tmax > 0 && tmax >= tmin && tmin < maxDistance)
+				return tmin;
+
+			return FLT_MAX;
+		}
+
+		//Only a tree deeper than BVH::MaxDepth (not built by BVH::Build, e.g. a damaged mesh cache) overflows a traversal stack.
+		//Checked in release builds too, writing past the stack would corrupt memory
+		[[noreturn]] inline void ReportTraversalStackOverflow()
+		{
+			std::cerr << "BVH traversal stack overflow, the tree is deeper than " << BVH::MaxDepth << " levels" << std::endl;
+			std::abort();
+		}
+
+		/**
+		 * \brief Ordered depth-first BVH traversal, the nearest child is visited first so the far one can be culled
+		 * \param maxDistance read again at every node, lets the leaf function shrink the search range
+		 * \param leafFunction called for every primitive in a visited leaf, returns true to stop the traversal
+		 */
+		template<typename LeafFunction>
+		inline void TraverseBVH(const BVH& bvh, const Ray& ray, const float& maxDistance, LeafFunction&& leafFunction)
+		{
+			if (bvh.IsEmpty())
+				return;
+
+			const Vector3 invDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			constexpr int maxStackSize = BVH::TraversalStackSize;
+			uint32_t stack[maxStackSize];
+			int stackSize = 0;
+
+			uint32_t nodeIndex = 0;
+			while (true)
 			{
-				return false;  
+				const BVHNode& node = bvh.nodes[nodeIndex];
+
+				if (node.IsLeaf())
+				{
+					for (uint32_t i = 0; i < node.primCount; ++i)
+					{
+						if (leafFunction(bvh.primIndices[node.leftFirst + i]))
+							return;
+					}
+
+					if (stackSize == 0)
+						return;
+
+					nodeIndex = stack[--stackSize];
+					continue;
+				}
+
+				uint32_t nearIndex = node.leftFirst;
+				uint32_t farIndex = node.leftFirst + 1;
+
+				float nearDistance = SlabTest_AABB(bvh.nodes[nearIndex].aabbMin, bvh.nodes[nearIndex].aabbMax, ray, invDirection, maxDistance);
+				float farDistance = SlabTest_AABB(bvh.nodes[farIndex].aabbMin, bvh.nodes[farIndex].aabbMax, ray, invDirection, maxDistance);
+
+				if (farDistance < nearDistance)
+				{
+					std::swap(nearIndex, farIndex);
+					std::swap(nearDistance, farDistance);
+				}
+
+				if (nearDistance == FLT_MAX)
+				{
+					if (stackSize == 0)
+						return;
+
+					nodeIndex = stack[--stackSize];
+					continue;
+				}
+
+				nodeIndex = nearIndex;
+
+				if (farDistance != FLT_MAX)
+				{
+					if (stackSize == maxStackSize)
+						ReportTraversalStackOverflow();
+					stack[stackSize++] = farIndex;
+				}
 			}
-			
-			HitRecord hit = {};
+		}
+
+		/**
+		 * \brief Ordered traversal of a 4-wide BVH, one SSE slab test per node checks all child boxes at once.
+		 * Hit children are visited nearest first, pending ones keep their entry distance so they can be culled later.
+		 * \param maxDistance read again at every node, lets the leaf function shrink the search range
+		 * \param leafFunction called with the first primitive and count of every visited leaf, returns true to stop the traversal
+		 */
+		template<typename LeafFunction>
+		inline void TraverseBVH4(std::span<const BVH4Node> nodes, const Ray& ray, const float& maxDistance, LeafFunction&& leafFunction)
+		{
+			if (nodes.empty())
+				return;
+
+			const __m128 originX = _mm_set1_ps(ray.origin.x);
+			const __m128 originY = _mm_set1_ps(ray.origin.y);
+			const __m128 originZ = _mm_set1_ps(ray.origin.z);
+
+			const __m128 invDirectionX = _mm_set1_ps(1.f / ray.direction.x);
+			const __m128 invDirectionY = _mm_set1_ps(1.f / ray.direction.y);
+			const __m128 invDirectionZ = _mm_set1_ps(1.f / ray.direction.z);
 
-			for (int i = 0; i < mesh.indices.size(); i += 3)
+			//Picking the near/far plane by direction sign makes the inverted boxes of empty slots always miss
+			const bool negativeX = ray.direction.x < 0.f;
+			const bool negativeY = ray.direction.y < 0.f;
+			const bool negativeZ = ray.direction.z < 0.f;
+
+			const __m128 zero = _mm_setzero_ps();
+
+			struct StackEntry
 			{
-				Triangle triangle =
-				{
-					mesh.transformedPositions[mesh.indices[i]],
-					mesh.transformedPositions[mesh.indices[i + 1]],
-					mesh.transformedPositions[mesh.indices[i + 2]],
-					mesh.transformedNormals[i / 3]
-				};
+				uint32_t child;
+				uint32_t count;
+				float distance;
+			};
 
-				triangle.cullMode = mesh.cullMode;
-				triangle.materialIndex = mesh.materialIndex;
+			constexpr int maxStackSize = BVH4::TraversalStackSize;
+			StackEntry stack[maxStackSize];
+			int stackSize = 0;
 
-				if (HitTest_Triangle(triangle, ray, hit))
+			stack[stackSize++] = { 0, 0, 0.f };
+
+			while (stackSize > 0)
+			{
+				const StackEntry entry = stack[--stackSize];
+
+				if (entry.distance >= maxDistance)
+					continue;
+
+				if (entry.count > 0)
 				{
-					if (ignoreHitRecord)
-						return true;
+					if (leafFunction(entry.child, entry.count))
+						return;
+					continue;
+				}
+
+				const BVH4Node& node = nodes[entry.child];
+
+				const __m128 nearX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(negativeX ? node.maxX : node.minX), originX), invDirectionX);
+				const __m128 nearY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(negativeY ? node.maxY : node.minY), originY), invDirectionY);
+				const __m128 nearZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(negativeZ ? node.maxZ : node.minZ), originZ), invDirectionZ);
+				const __m128 farX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(negativeX ? node.minX : node.maxX), originX), invDirectionX);
+				const __m128 farY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(negativeY ? node.minY : node.maxY), originY), invDirectionY);
+				const __m128 farZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(negativeZ ? node.minZ : node.maxZ), originZ), invDirectionZ);
+
+				const __m128 tmin = _mm_max_ps(nearX, _mm_max_ps(nearY, nearZ));
+				const __m128 tmax = _mm_min_ps(farX, _mm_min_ps(farY, farZ));
+
+				const __m128 hit = _mm_and_ps(
+					_mm_and_ps(_mm_cmpge_ps(tmax, tmin), _mm_cmpgt_ps(tmax, zero)),
+					_mm_cmplt_ps(tmin, _mm_set1_ps(maxDistance)));
+
+				int hitMask = _mm_movemask_ps(hit);
+				if (hitMask == 0)
+					continue;
+
+				alignas(16) float distances[4];
+				_mm_store_ps(distances, tmin);
+
+				//Insertion sort the hit children far to near, so the nearest ends up on top of the stack
+				StackEntry hitChildren[4];
+				int hitCount = 0;
 
-					if (hit.t < hitRecord.t)
-						hitRecord = hit;
+				while (hitMask)
+				{
+					const int slot = std::countr_zero(static_cast<unsigned>(hitMask));
+					hitMask &= hitMask - 1;
+
+					const StackEntry child{ node.child[slot], node.count[slot], distances[slot] };
+
+					int i = hitCount++;
+					while (i > 0 && hitChildren[i - 1].distance < child.distance)
+					{
+						hitChildren[i] = hitChildren[i - 1];
+						--i;
+					}
+					hitChildren[i] = child;
+				}
 
+				if (stackSize + hitCount > maxStackSize)
+					ReportTraversalStackOverflow();
+				for (int i = 0; i < hitCount; ++i)
+				{
+					stack[stackSize++] = hitChildren[i];
 				}
 			}
-			if (hitRecord.didHit)
+		}
+
+		//Direction is not normalized, so t is the same in object and world space
+		inline Ray GetObjectSpaceRay(const TriangleMesh& mesh, const Ray& ray)
+		{
+			return
 			{
-				hitRecord.materialIndex = mesh.materialIndex;
-				return true;
+				mesh.inverseTransform.TransformPoint(ray.origin),
+				mesh.inverseTransform.TransformVector(ray.direction),
+				ray.min,
+				ray.max
+			};
+		}
+
+		//Occlusion only (shadow rays), stops at the first block with a hit.
+		//pOccluderTriangle receives the block index * TriangleBlock::Size + lane of the triangle that was hit
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, uint32_t* pOccluderTriangle = nullptr)
+		{
+			if (!SlabTest_TriangleMesh(mesh, ray))
+			{
+				return false;
 			}
-			return false;
+
+			const Ray objectRay = GetObjectSpaceRay(mesh, ray);
+			const std::span<const TriangleBlock> blocks = mesh.GetTriangleBlocks();
+
+			bool didHit = false;
+
+			TraverseBVH4(mesh.GetBVHNodes(), objectRay, objectRay.max, [&](uint32_t blockIndex, uint32_t)
+				{
+					//Meshes cull shadow rays like regular rays
+					float distances[TriangleBlock::Size];
+					const uint32_t hitMask = IntersectTriangleBlock(blocks[blockIndex], objectRay, mesh.cullMode, objectRay.max, distances);
+					if (hitMask == 0)
+						return false;
+
+					if (pOccluderTriangle)
+						*pOccluderTriangle = blockIndex * TriangleBlock::Size + std::countr_zero(hitMask);
+
+					didHit = true;
+					return true;
+				});
+
+			return didHit;
 		}
 
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		//Occlusion test against a single triangle of the mesh, used to re-test a cached occluder
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, uint32_t triangleIndex, const Ray& ray)
 		{
-			HitRecord temp = {};
-			return HitTest_TriangleMesh(mesh, ray, temp, true);
+			const std::span<const TriangleBlock> blocks = mesh.GetTriangleBlocks();
+			const uint32_t blockIndex = triangleIndex / TriangleBlock::Size;
+			if (blockIndex >= blocks.size())
+				return false;
+
+			const Ray objectRay = GetObjectSpaceRay(mesh, ray);
+
+			float distances[TriangleBlock::Size];
+			const uint32_t hitMask = IntersectTriangleBlock(blocks[blockIndex], objectRay, mesh.cullMode, objectRay.max, distances);
+			return (hitMask >> (triangleIndex % TriangleBlock::Size)) & 1;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (ignoreHitRecord)
+			{
+				return HitTest_TriangleMesh(mesh, ray);
+			}
+
+			if (!SlabTest_TriangleMesh(mesh, ray))
+			{
+				return false;  
+			}
+
+			const Ray objectRay = GetObjectSpaceRay(mesh, ray);
+
+			float maxDistance = objectRay.max;
+			uint32_t closestBlock = UINT32_MAX;
+			uint32_t closestLane = 0;
+
+			const std::span<const TriangleBlock> blocks = mesh.GetTriangleBlocks();
+
+			TraverseBVH4(mesh.GetBVHNodes(), objectRay, maxDistance, [&](uint32_t blockIndex, uint32_t)
+				{
+					float distances[TriangleBlock::Size];
+					uint32_t hitMask = IntersectTriangleBlock(blocks[blockIndex], objectRay, mesh.cullMode, maxDistance, distances);
+
+					while (hitMask)
+					{
+						const int lane = std::countr_zero(hitMask);
+						hitMask &= hitMask - 1;
+
+						if (distances[lane] < maxDistance)
+						{
+							maxDistance = distances[lane];
+							closestBlock = blockIndex;
+							closestLane = lane;
+						}
+					}
+					return false;
+				});
+
+			if (closestBlock != UINT32_MAX && maxDistance < hitRecord.t)
+			{
+				//Back to world space
+				hitRecord.t = maxDistance;
+				hitRecord.origin = ray.origin + ray.direction * maxDistance;
+				const TriangleBlock& block = blocks[closestBlock];
+				const Vector3 normal = { block.normalX[closestLane], block.normalY[closestLane], block.normalZ[closestLane] };
+
+				hitRecord.normal = mesh.normalTransform.TransformVector(normal).Normalized();
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = mesh.materialIndex;
+				return true;
+			}
+			return false;
 		}
 
 		
@@ -321,13 +930,13 @@ namespace dae
 				Vector3 edgeV0V2 = positions[i2] - positions[i0];
 				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
 
-				if (isnan(normal.x))
+				if (std::isnan(normal.x))
 				{
 					int k = 0;
 				}
 
 				normal.Normalize();
-				if (isnan(normal.x))
+				if (std::isnan(normal.x))
 				{
 					int k = 0;
 				}
@@ -6,9 +6,11 @@
 
 //Standard includes
 #include <iostream>
+#include <utility>
 
 //Project includes
 #include "Timer.h"
+#include "FrameBuffer.h"
 #include "Renderer.h"
 #include "Scene.h"
 
@@ -20,6 +22,35 @@ void ShutDown(SDL_Window* pWindow)
 	SDL_Quit();
 }
 
+CameraInput ReadCameraInput()
+{
+	CameraInput input{};
+
+	const uint8_t* pKeyboardState = SDL_GetKeyboardState(nullptr);
+	input.moveForward = pKeyboardState[SDL_SCANCODE_W];
+	input.moveBackward = pKeyboardState[SDL_SCANCODE_S];
+	input.moveRight = pKeyboardState[SDL_SCANCODE_D];
+	input.moveLeft = pKeyboardState[SDL_SCANCODE_A];
+
+	const uint32_t mouseState = SDL_GetRelativeMouseState(&input.mouseX, &input.mouseY);
+	input.isLeftMousePressed = mouseState & SDL_BUTTON(SDL_BUTTON_LEFT);
+	input.isRightMousePressed = mouseState & SDL_BUTTON(SDL_BUTTON_RIGHT);
+
+	return input;
+}
+
+//Copies the frame into the window, converting it to the window's pixel format if needed
+void Present(SDL_Window* pWindow, const FrameBuffer& frameBuffer)
+{
+	SDL_Surface* pFrameSurface = SDL_CreateRGBSurfaceWithFormatFrom(const_cast<uint32_t*>(frameBuffer.GetPixels()),
+		frameBuffer.GetWidth(), frameBuffer.GetHeight(), 32, frameBuffer.GetWidth() * sizeof(uint32_t), SDL_PIXELFORMAT_ARGB8888);
+
+	SDL_BlitSurface(pFrameSurface, nullptr, SDL_GetWindowSurface(pWindow), nullptr);
+	SDL_UpdateWindowSurface(pWindow);
+
+	SDL_FreeSurface(pFrameSurface);
+}
+
 int main(int argc, char* args[])
 {
 	//Unreferenced parameters
@@ -43,19 +74,29 @@ int main(int argc, char* args[])
 
 	//Initialize "framework"
 	const auto pTimer = new Timer();
-	const auto pRenderer = new Renderer(pWindow);
+	const auto pRenderer = new Renderer(width, height);
 
-	const auto pScene = new Scene_W4_ReferenceScene();
-	//const auto pScene = new Scene_W4_BunnyScene();
-	//const auto pScene = new Scene_LowpolyMan();
+	using SceneType = Scene_W4_ReferenceScene;
+	//using SceneType = Scene_W4_BunnyScene;
+	//using SceneType = Scene_LowpolyMan;
+	//using SceneType = Scene_ManyLights;
+
+	//Two instances of the scene: one is rendered while the other is updated for the next frame
+	Scene* pScene = new SceneType();
+	Scene* pNextScene = new SceneType();
 	pScene->Initialize();
+	pNextScene->Initialize();
 
 	//Start loop
 	pTimer->Start();
 
+	pScene->Update(pTimer);
+	pScene->UpdateAccelerationStructure();
+
 	float printTimer = 0.f;
 	bool isLooping = true;
 	bool takeScreenshot = false;
+	bool pipelineFrames = true;
 	while (isLooping)
 	{
 		//--------- Get input events ---------
@@ -80,8 +121,40 @@ int main(int argc, char* args[])
 					pRenderer->CycleLightingMode();
 				
 
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+					pRenderer->TogglePacketTracing();
+				
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+				{
+					pipelineFrames = !pipelineFrames;
+					std::cout << "Frame pipelining " << (pipelineFrames ? "ON" : "OFF") << std::endl;
+				}
+
+
 				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
 					pTimer->StartBenchmark();
+
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+					pRenderer->ToggleProgressiveRendering();
+
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					pRenderer->ToggleAntiAliasing();
+
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					pRenderer->CycleTemporalMode();
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+					pRenderer->ToggleDirtyRegions();
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F11)
+					pRenderer->ToggleWavefront();
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F12)
+					pRenderer->ToggleLightSampling();
 				break;
 
 			case SDL_MOUSEWHEEL:
@@ -98,27 +171,58 @@ int main(int argc, char* args[])
 			}
 		}
 
-		//--------- Update ---------
-		pScene->Update(pTimer);
+		if (pipelineFrames)
+		{
+			//--------- Render ---------
+			//pScene only gets read from here on, until the render is done
+			auto renderResult = pRenderer->RenderAsync(pScene);
+
+			//Meanwhile, present the previous frame...
+			Present(pWindow, pRenderer->GetFrameBuffer());
+
+			//--------- Timer ---------
+			pTimer->Update();
+
+			//--------- Update ---------
+			//...and prepare the next one
+			pNextScene->GetCamera() = pScene->GetCamera();
+			pNextScene->GetCamera().input = ReadCameraInput();
+			pNextScene->Update(pTimer);
+			pNextScene->UpdateAccelerationStructure();
+
+			renderResult.wait();
+			pRenderer->SwapFrameBuffers();
+			std::swap(pScene, pNextScene);
+		}
+		else
+		{
+			//--------- Render ---------
+			pRenderer->Render(pScene);
+			Present(pWindow, pRenderer->GetFrameBuffer());
+
+			//--------- Timer ---------
+			pTimer->Update();
 
-		//--------- Render ---------
-		pRenderer->Render(pScene);
+			//--------- Update ---------
+			pScene->GetCamera().input = ReadCameraInput();
+			pScene->Update(pTimer);
+			pScene->UpdateAccelerationStructure();
+		}
 
-		//--------- Timer ---------
-		pTimer->Update();
+		pTimer->AddBenchmarkSamplesPerPixel(pRenderer->GetSamplesPerPixel());
 
 		printTimer += pTimer->GetElapsed();
 
 		if (printTimer >= 1.f)
 		{
 			printTimer = 0.f;
-			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			std::cout << "dFPS: " << pTimer->GetdFPS() << " (load imbalance " << pRenderer->GetLoadImbalance() << ", " << pRenderer->GetSamplesPerPixel() << " spp, " << pRenderer->GetReusedPixelRatio() * 100.f << "% reused, " << pRenderer->GetDirtyTileRatio() * 100.f << "% dirty tiles)" << std::endl;
 		}
 
 		//Save screenshot after full render
 		if (takeScreenshot)
 		{
-			if (!pRenderer->SaveBufferToImage())
+			if (pRenderer->SaveBufferToImage())
 				std::cout << "Screenshot saved!" << std::endl;
 			else
 				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
@@ -129,6 +233,7 @@ int main(int argc, char* args[])
 
 	//Shutdown "framework"
 	delete pScene;
+	delete pNextScene;
 	delete pRenderer;
 	delete pTimer;
 